@@ -0,0 +1,156 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file binary_format.c
+   @brief Implementation of @c binary_format.h
+
+*/
+#include "binary_format.h"
+#include <errno.h>
+
+/**
+   \brief terminates the program reporting that the binary file read by \c rp
+   is malformed
+*/
+static void
+binary_error(const reader_s* rp, const char* message) {
+        error(2, 0, "Badly formatted binary file: %s: %s\n", rp->filename, message);
+}
+
+bool
+binary_file_p(reader_s* rp) {
+        if (reader_end_of_file(rp))
+                return false;
+        size_t available = rp->size - rp->pos;
+        if (available > sizeof(BINARY_MAGIC))
+                available = sizeof(BINARY_MAGIC);
+        bool binary = (memcmp(rp->data + rp->pos, BINARY_MAGIC, available) == 0);
+        if (binary && !rp->mapped)
+                error(3, 0, "Binary input must be a regular file: %s\n", rp->filename);
+        return binary;
+}
+
+const binary_header_s*
+binary_read_header(reader_s* rp) {
+        assert(rp->mapped);
+        if (rp->size < sizeof(binary_header_s))
+                binary_error(rp, "truncated header");
+        const binary_header_s* hp = (const binary_header_s*) rp->data;
+        if (memcmp(hp->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+                binary_error(rp, "wrong magic number");
+        if (hp->version != BINARY_VERSION)
+                binary_error(rp, "unsupported version");
+        if (hp->num_species == 0 || hp->num_characters == 0)
+                binary_error(rp, "the number of species and of characters must be positive");
+        if (hp->table_offset % sizeof(uint64_t) != 0 || hp->table_offset > rp->size ||
+            hp->num_instances > (rp->size - hp->table_offset) / sizeof(uint64_t))
+                binary_error(rp, "truncated table of instances");
+        log_debug("binary_read_header: %"PRIu32" species, %"PRIu32" characters, %"PRIu64" instances",
+                  hp->num_species, hp->num_characters, hp->num_instances);
+        return hp;
+}
+
+bitmap_word*
+binary_instance_rows(reader_s* rp, const binary_header_s* hp, uint64_t i, uint32_t* cell_bits) {
+        assert(i < hp->num_instances);
+        uint64_t offset = ((const uint64_t*) (rp->data + hp->table_offset))[i];
+        if (offset % sizeof(uint64_t) != 0 || offset > hp->table_offset ||
+            hp->table_offset - offset < sizeof(binary_instance_s))
+                binary_error(rp, "wrong position of an instance");
+        const binary_instance_s* ip = (const binary_instance_s*) (rp->data + offset);
+        if (ip->cell_bits != 1 && ip->cell_bits != 2)
+                binary_error(rp, "wrong number of bits of the cells");
+        uint64_t row_words = BITMAP_NWORDS((uint64_t) ip->cell_bits * hp->num_characters);
+        if ((hp->table_offset - offset - sizeof(binary_instance_s)) / sizeof(bitmap_word) < row_words * hp->num_species)
+                binary_error(rp, "truncated instance");
+        *cell_bits = ip->cell_bits;
+        return (bitmap_word*) (rp->data + offset + sizeof(binary_instance_s));
+}
+
+/**
+   \brief writes \c size bytes, terminating the program in case of errors
+*/
+static void
+binary_write(binary_writer_s* wp, const void* data, size_t size) {
+        if (size > 0 && fwrite(data, size, 1, wp->file) != 1)
+                error(7, errno, "Could not write the output file\n");
+        wp->position += size;
+}
+
+binary_writer_s*
+binary_writer_open(FILE* file, uint32_t num_species, uint32_t num_characters) {
+        binary_writer_s* wp = xmalloc(sizeof(binary_writer_s));
+        wp->file = file;
+        memset(&(wp->header), 0, sizeof(wp->header));
+        memcpy(wp->header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        wp->header.version = BINARY_VERSION;
+        wp->header.num_species = num_species;
+        wp->header.num_characters = num_characters;
+        wp->header.num_instances = 0;
+        wp->capacity = 64;
+        wp->offsets = xmalloc(wp->capacity * sizeof(uint64_t));
+        wp->position = 0;
+/*
+  The header is written again by binary_writer_close, when the number of
+  instances and the position of the table are known
+*/
+        binary_write(wp, &(wp->header), sizeof(wp->header));
+        return wp;
+}
+
+void
+binary_write_instance(binary_writer_s* wp, const uint8_t* cells) {
+        uint32_t n = wp->header.num_species;
+        uint32_t m = wp->header.num_characters;
+        binary_instance_s instance = { .cell_bits = 1, .reserved = 0 };
+        for (uint64_t i = 0; i < (uint64_t) n * m; i++)
+                if (cells[i] > 1)
+                        instance.cell_bits = 2;
+
+        if (wp->header.num_instances == wp->capacity) {
+                wp->capacity *= 2;
+                wp->offsets = xrealloc(wp->offsets, wp->capacity * sizeof(uint64_t));
+        }
+        wp->offsets[wp->header.num_instances++] = wp->position;
+        binary_write(wp, &instance, sizeof(instance));
+
+        uint32_t row_words = BITMAP_NWORDS(instance.cell_bits * m);
+        bitmap_word row[row_words + 1];
+        for (uint32_t s = 0; s < n; s++) {
+                memset(row, 0, row_words * sizeof(bitmap_word));
+                for (uint32_t c = 0; c < m; c++) {
+                        uint64_t bit = (uint64_t) instance.cell_bits * c;
+                        BITMAP_WORD(row, bit) |= (bitmap_word) cells[s * m + c] << BITMAP_BIT_OFFSET(bit);
+                }
+                binary_write(wp, row, row_words * sizeof(bitmap_word));
+        }
+}
+
+void
+binary_writer_close(binary_writer_s* wp) {
+        wp->header.table_offset = wp->position;
+        binary_write(wp, wp->offsets, wp->header.num_instances * sizeof(uint64_t));
+        if (fseek(wp->file, 0, SEEK_SET) != 0)
+                error(7, errno, "The output file must be seekable\n");
+        binary_write(wp, &(wp->header), sizeof(wp->header));
+        fflush(wp->file);
+}
@@ -0,0 +1,147 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file binary_format.h
+   @brief The binary format of the files containing the matrices.
+
+   A binary file consists of:
+
+   * a \c binary_header_s, with the number of species and of characters
+   (common to all instances), the number of instances and the position of
+   the table of instances,
+
+   * the instances. Each instance is a \c binary_instance_s, followed by a
+   row for each species. A row consists of \c BITMAP_NWORDS(cell_bits *
+   num_characters) words of type \c bitmap_word, and the value of each
+   cell is stored in \c cell_bits bits (in the same order as the bits of a
+   bitmap). \c cell_bits is 1, unless the instance contains some cell
+   equal to 2, in which case it is 2,
+
+   * the table of instances: the position in the file of each instance,
+   as a \c uint64_t.
+
+   All values are stored in the byte order of the machine and all positions
+   are multiples of 8, so that a mapped file can be accessed directly. When
+   \c cell_bits is 1, the rows have the same layout as the \c matrix of a
+   state.
+*/
+#ifndef CPPP_BINARY_FORMAT_H
+#define CPPP_BINARY_FORMAT_H
+#include "reader.h"
+#include "bitmap.h"
+
+#define BINARY_MAGIC            "CPPPBIN"
+#define BINARY_VERSION          1
+
+/**
+   \struct binary_header_s
+   \brief the header of a binary file. \c magic is \c BINARY_MAGIC
+*/
+typedef struct binary_header_s {
+        char magic[8];
+        uint32_t version;
+        uint32_t num_species;
+        uint32_t num_characters;
+        uint32_t reserved;
+        uint64_t num_instances;
+        uint64_t table_offset;
+} binary_header_s;
+
+/**
+   \struct binary_instance_s
+   \brief the header of each instance of a binary file
+*/
+typedef struct binary_instance_s {
+        uint32_t cell_bits;
+        uint32_t reserved;
+} binary_instance_s;
+
+/**
+   \struct binary_writer_s
+   \brief a binary file that is being written.
+
+   \c offsets contains the position of the \c header.num_instances instances
+   written so far.
+*/
+typedef struct binary_writer_s {
+        FILE *file;
+        binary_header_s header;
+        uint64_t *offsets;
+        uint64_t capacity;
+        uint64_t position;
+} binary_writer_s;
+
+/**
+   \brief \return \c true iff the file read by \c rp is a binary file
+*/
+bool
+binary_file_p(reader_s* rp);
+
+/**
+   \brief checks the header of the binary file read by \c rp, terminating the
+   program if the file is malformed.
+
+   \return the header
+*/
+const binary_header_s*
+binary_read_header(reader_s* rp);
+
+/**
+   \brief \return the rows of the instance \c i of the binary file read by \c
+   rp, storing in \c cell_bits the number of bits of each cell. The rows are
+   in the mapped file, therefore they cannot be modified.
+*/
+bitmap_word*
+binary_instance_rows(reader_s* rp, const binary_header_s* hp, uint64_t i, uint32_t* cell_bits);
+
+/**
+   \brief \return the value of the cell \c (s,c) in the \c rows of an
+   instance with \c num_characters characters.
+*/
+static inline uint8_t
+binary_cell(const bitmap_word* rows, uint32_t num_characters, uint32_t cell_bits, uint32_t s, uint32_t c) {
+        const bitmap_word* row = rows + s * BITMAP_NWORDS(cell_bits * num_characters);
+        uint64_t bit = (uint64_t) cell_bits * c;
+        return (uint8_t) ((BITMAP_WORD(row, bit) >> BITMAP_BIT_OFFSET(bit)) & ((1U << cell_bits) - 1));
+}
+
+/**
+   \brief managing the writing of binary files:
+   \c binary_writer_open starts writing a binary file on \c file, which must
+   be seekable.
+
+   \c binary_write_instance appends an instance, whose cells are in \c
+   cells, one for each species and character, in row-major order.
+
+   \c binary_writer_close writes the table of instances and the final
+   header.
+*/
+binary_writer_s*
+binary_writer_open(FILE* file, uint32_t num_species, uint32_t num_characters);
+
+void
+binary_write_instance(binary_writer_s* wp, const uint8_t* cells);
+
+void
+binary_writer_close(binary_writer_s* wp);
+
+#endif
@@ -1,13 +1,18 @@
 /* Licensed under LGPLv2+
    Originally from CCAN bitmap.h
 */
+#ifndef CCAN_BITMAP_H
+#define CCAN_BITMAP_H
 
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <gc.h>
+#include "memory.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 
 typedef uint64_t bitmap_word;
@@ -20,7 +25,7 @@ typedef uint64_t bitmap_word;
 #define BITMAP_HEADWORDS(_n)    ((_n) / BITMAP_WORD_BITS)
 #define BITMAP_TAILWORD(_bm,_n) ((_bm)[BITMAP_HEADWORDS(_n)])
 #define BITMAP_HASTAIL(_n)      (((_n) % BITMAP_WORD_BITS) != 0)
-#define BITMAP_TAILBITS(_n)     (~(-1UL >> ((_n) % BITMAP_WORD_BITS)))
+#define BITMAP_TAILBITS(_n)     ((1UL << ((_n) % BITMAP_WORD_BITS)) - 1)
 #define BITMAP_TAIL(_bm,_n)     (BITMAP_TAILWORD(_bm, _n) & BITMAP_TAILBITS(_n))
 #define BITMAP_WORD(_bm,_n)     ((_bm)[(_n) >> LOG_BITMAP_WORD_BITS])
 #define BITMAP_BIT_MASK(_n)     (1UL << (BITMAP_BIT_OFFSET(_n)))
@@ -30,7 +35,7 @@ static inline size_t bitmap_sizeof(unsigned long nbits) {
 }
 
 static inline bitmap_word *bitmap_alloc(unsigned long nbits) {
-        return GC_MALLOC(bitmap_sizeof(nbits));
+        return xmalloc(bitmap_sizeof(nbits));
 }
 
 static inline void bitmap_zero(bitmap_word *bitmap, unsigned long nbits) {
@@ -48,7 +53,7 @@ static inline void bitmap_set_bit(bitmap_word *bitmap, unsigned long n) {
         BITMAP_WORD(bitmap, n) |= BITMAP_BIT_MASK(n);
 }
 
-static inline bool bitmap_get_bit(bitmap_word *bitmap, unsigned long n) {
+static inline bool bitmap_get_bit(const bitmap_word *bitmap, unsigned long n) {
         return ((BITMAP_WORD(bitmap, n) & BITMAP_BIT_MASK(n))  > 0);
 }
 
@@ -60,7 +65,7 @@ static inline void bitmap_copy(bitmap_word *dst, const bitmap_word *src, unsigne
         memcpy(dst, src, bitmap_sizeof(nbits));
 }
 
-static inline bool bitmap_includes(bitmap_word *src1, const bitmap_word *src2, unsigned long nbits) {
+static inline bool bitmap_includes(const bitmap_word *src1, const bitmap_word *src2, unsigned long nbits) {
         unsigned long i;
         for (i = 0; i < BITMAP_HEADWORDS(nbits); i++) {
                 if (src1[i]  & ~src2[i])
@@ -72,6 +77,154 @@ static inline bool bitmap_includes(bitmap_word *src1, const bitmap_word *src2, u
         return true;
 }
 
+/**
+   \brief number of bits set in the bitmap
+*/
+static inline uint32_t bitmap_popcount(const bitmap_word *bitmap, unsigned long nbits) {
+        uint32_t count = 0;
+        for (unsigned long i = 0; i < BITMAP_HEADWORDS(nbits); i++)
+                count += __builtin_popcountl(bitmap[i]);
+        if (BITMAP_HASTAIL(nbits))
+                count += __builtin_popcountl(BITMAP_TAIL(bitmap, nbits));
+        return count;
+}
+
+/**
+   \brief the smallest bit set in the bitmap that is at least \c n, or \c
+   nbits if there is no such bit
+*/
+static inline unsigned long bitmap_next_set(const bitmap_word *bitmap, unsigned long nbits, unsigned long n) {
+        if (n >= nbits)
+                return nbits;
+        unsigned long i = BITMAP_BIT_PLACE(n);
+        bitmap_word w = bitmap[i] & (-1UL << BITMAP_BIT_OFFSET(n));
+        while (w == 0) {
+                if (++i >= BITMAP_NWORDS(nbits))
+                        return nbits;
+                w = bitmap[i];
+        }
+        unsigned long next = i * BITMAP_WORD_BITS + __builtin_ctzl(w);
+        return (next < nbits) ? next : nbits;
+}
+
+
+/**
+   \brief the smallest bit not set in the bitmap that is at least \c n, or \c
+   nbits if there is no such bit
+*/
+static inline unsigned long bitmap_next_zero(const bitmap_word *bitmap, unsigned long nbits, unsigned long n) {
+        if (n >= nbits)
+                return nbits;
+        unsigned long i = BITMAP_BIT_PLACE(n);
+        bitmap_word w = ~bitmap[i] & (-1UL << BITMAP_BIT_OFFSET(n));
+        while (w == 0) {
+                if (++i >= BITMAP_NWORDS(nbits))
+                        return nbits;
+                w = ~bitmap[i];
+        }
+        unsigned long next = i * BITMAP_WORD_BITS + __builtin_ctzl(w);
+        return (next < nbits) ? next : nbits;
+}
+
+/**
+   \brief \c dst |= \c src, on the first \c nwords words.
+
+   Uses AVX2 if available (e.g. with -march=native), otherwise a scalar loop.
+*/
+static inline void bitmap_or_words(bitmap_word *dst, const bitmap_word *src, unsigned long nwords) {
+        unsigned long i = 0;
+#ifdef __AVX2__
+        for (; i + 4 <= nwords; i += 4) {
+                __m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+                __m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+                _mm256_storeu_si256((__m256i *) (dst + i), _mm256_or_si256(d, s));
+        }
+#endif
+        for (; i < nwords; i++)
+                dst[i] |= src[i];
+}
+
+/**
+   \brief one step of a bit-parallel visit: removes from \c frontier the
+   bits already in \c visited, then adds \c frontier to \c visited.
+
+   \return true if the resulting \c frontier is not empty
+*/
+static inline bool bitmap_advance_frontier(bitmap_word *frontier, bitmap_word *visited, unsigned long nwords) {
+        unsigned long i = 0;
+        bitmap_word any = 0;
+#ifdef __AVX2__
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 4 <= nwords; i += 4) {
+                __m256i f = _mm256_loadu_si256((const __m256i *) (frontier + i));
+                __m256i v = _mm256_loadu_si256((const __m256i *) (visited + i));
+                f = _mm256_andnot_si256(v, f);
+                _mm256_storeu_si256((__m256i *) (frontier + i), f);
+                _mm256_storeu_si256((__m256i *) (visited + i), _mm256_or_si256(v, f));
+                acc = _mm256_or_si256(acc, f);
+        }
+        any = !_mm256_testz_si256(acc, acc);
+#endif
+        for (; i < nwords; i++) {
+                frontier[i] &= ~visited[i];
+                visited[i] |= frontier[i];
+                any |= frontier[i];
+        }
+        return any != 0;
+}
+
+/**
+   \brief the four gametes test between two columns \c a and \c b of a
+   binary matrix, stored as bitmaps of \c nwords words whose bits are the
+   rows (species). Only the rows in \c mask are considered and \c a, \c b
+   must be included in \c mask.
+
+   \return true iff there are rows with each of the values 11, 10, 01, 00
+*/
+static inline bool bitmap_four_gametes(const bitmap_word *a, const bitmap_word *b, const bitmap_word *mask, unsigned long nwords) {
+        unsigned long i = 0;
+        bitmap_word g11 = 0, g10 = 0, g01 = 0, g00 = 0;
+#ifdef __AVX2__
+        __m256i a11 = _mm256_setzero_si256();
+        __m256i a10 = _mm256_setzero_si256();
+        __m256i a01 = _mm256_setzero_si256();
+        __m256i a00 = _mm256_setzero_si256();
+        for (; i + 4 <= nwords; i += 4) {
+                __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+                __m256i z = _mm256_loadu_si256((const __m256i *) (mask + i));
+                a11 = _mm256_or_si256(a11, _mm256_and_si256(x, y));
+                a10 = _mm256_or_si256(a10, _mm256_andnot_si256(y, x));
+                a01 = _mm256_or_si256(a01, _mm256_andnot_si256(x, y));
+                a00 = _mm256_or_si256(a00, _mm256_andnot_si256(_mm256_or_si256(x, y), z));
+        }
+        g11 = !_mm256_testz_si256(a11, a11);
+        g10 = !_mm256_testz_si256(a10, a10);
+        g01 = !_mm256_testz_si256(a01, a01);
+        g00 = !_mm256_testz_si256(a00, a00);
+#endif
+        for (; i < nwords; i++) {
+                g11 |= a[i] & b[i];
+                g10 |= a[i] & ~b[i];
+                g01 |= ~a[i] & b[i];
+                g00 |= mask[i] & ~(a[i] | b[i]);
+        }
+        return g11 != 0 && g10 != 0 && g01 != 0 && g00 != 0;
+}
+
+/**
+   \brief a hash of the first \c nwords words of a bitmap, so that equal
+   bitmaps have the same hash
+*/
+static inline uint64_t bitmap_hash(const bitmap_word *bitmap, unsigned long nwords) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (unsigned long i = 0; i < nwords; i++) {
+                h ^= bitmap[i];
+                h *= 0x100000001b3ULL;
+                h ^= h >> 29;
+        }
+        return h;
+}
 
 /**
    \brief true if the first array includes the second
@@ -104,8 +257,9 @@ bool_array_equal(bool* a1, bool* a2, uint32_t n) {
 */
 static inline bool*
 bool_array_difference(const bool* a1, const bool* a2, uint32_t n) {
-        bool* b = GC_MALLOC(n * sizeof(bool));
+        bool* b = xmalloc(n * sizeof(bool));
         for (uint32_t i = 0; i < n; i++)
                 b[i] = (a1[i] && !a2[i]);
         return b;
 }
+#endif /* CCAN_BITMAP_H */
@@ -21,56 +21,323 @@
 
 #include "cppp.h"
 
+/**
+   \brief the number of instances read for each job before solving them in
+   parallel
+*/
+#define INSTANCES_PER_JOB 16
+
 static uint32_t
-alphabetic(state_s *stp, uint32_t *arr) {
-        return (characters_list(stp, arr));
+restart_schedule(const char* name) {
+        if (!strcmp(name, "luby"))
+                return RESTART_LUBY;
+        if (!strcmp(name, "geometric"))
+                return RESTART_GEOMETRIC;
+        return RESTART_NONE;
+}
+
+static uint32_t
+graph_representation(const char* name) {
+        if (!strcmp(name, "bitmap"))
+                return GRAPH_BITMAP;
+        if (!strcmp(name, "bipartite"))
+                return GRAPH_BIPARTITE;
+        return GRAPH_DENSE;
+}
+
+/**
+   \brief solves the instance \c temp, returning the phylogeny in Newick
+   format, or "Not found". If the budget of the search is exhausted, the
+   result is "Unknown", followed by the work done. The statistics of the
+   search are stored in \c stats.
+
+   Each call has its own states and graphs, therefore different instances can
+   be solved concurrently. If \c threads is larger than 1, the decision tree
+   is searched in parallel, and \c undo must be \c false, since the graphs
+   cannot be shared among levels.
+   The characters of each node are tried in the order given by \c strategy.
+   An instance with a perfect phylogeny is solved without search. If \c
+   greedy is \c true, the greedy reduction (see reduction.h) is tried
+   before the search, which is needed only if the reduction fails.
+*/
+static char*
+solve_instance(state_s* temp, strategy_fn strategy, bool undo, uint32_t threads, bool greedy, search_stats_s* stats) {
+        assert(!undo || threads == 1);
+        double start = monotonic_seconds();
+        char* tree = perfect_phylogeny_newick(temp);
+        if (tree != NULL) {
+                log_debug("Perfect phylogeny");
+                *stats = (search_stats_s) {
+                        .outcome = SEARCH_FOUND,
+                        .perfect_phylogeny = true,
+                        .seconds = monotonic_seconds() - start
+                };
+                return tree;
+        }
+/**
+   Notice that each character is realized at most twice (once positive and once
+   negative) and that each species can be declared null at most once.
+
+   Therefore each partial solution con contain at most 2m+n states.
+*/
+        uint32_t maxdepth = temp->num_species_orig + 2 * temp->num_characters_orig + 1;
+        if (greedy) {
+                state_s* levels = xmalloc((maxdepth + 1) * sizeof(state_s));
+                init_state(levels + 0, temp->num_species_orig, temp->num_characters_orig);
+                copy_state(levels + 0, temp);
+                if (reduction_search(levels, maxdepth, stats) == SEARCH_FOUND) {
+                        log_debug("Writing the reduction");
+                        stats->reduction = true;
+                        return newick(levels);
+                }
+                log_debug("The greedy reduction has failed");
+        }
+/*
+  Only the first level is initialized here: the search initializes the other
+  levels when it reaches them, since most searches visit only a few of them.
+  With undo, the second level creates the trail shared by all levels.
+*/
+        state_s* states = xmalloc((maxdepth + 1) * sizeof(state_s));
+        init_state(states + 0, temp->num_species_orig, temp->num_characters_orig);
+        if (undo)
+                init_shared_state(states + 1, states + 0);
+        log_debug("States initialized");
+        check_state(temp);
+
+        copy_state(states + 0, temp);
+        char* result = "Not found";
+        uint32_t outcome = (threads > 1) ?
+                parallel_exhaustive_search(states, strategy, maxdepth, threads, stats) :
+                exhaustive_search(states, strategy, states[0].num_species + 2 * states[0].num_characters, stats);
+        if (outcome == SEARCH_FOUND) {
+                log_debug("Writing solution");
+                result = newick(states);
+        }
+        if (outcome == SEARCH_UNKNOWN) {
+                result = xmalloc(128);
+                snprintf(result, 128, "Unknown nodes=%" PRIu64 " backtracks=%" PRIu64 " seconds=%.3f",
+                         stats->nodes, stats->backtracks, stats->seconds);
+        }
+        log_debug("Instance solved");
+        return result;
+}
+
+/**
+   \brief writes to \c statsf the statistics of the search of the instance
+   \c instance (starting from 1), which has been read in \c parse_seconds
+   seconds, as a JSON object on a single line
+*/
+static void
+write_stats(FILE* statsf, uint32_t instance, double parse_seconds, const search_stats_s* stats) {
+        static const char* outcomes[] = {
+                [SEARCH_NOT_FOUND] = "not found",
+                [SEARCH_FOUND] = "found",
+                [SEARCH_UNKNOWN] = "unknown"
+        };
+        fprintf(statsf, "{\"instance\": %" PRIu32 ", \"result\": \"%s\", ", instance, outcomes[stats->outcome]);
+        fprintf(statsf, "\"nodes\": %" PRIu64 ", \"next_node\": %" PRIu64 ", \"backtracks\": %" PRIu64 ", \"completed_components\": %" PRIu64 ", ",
+                stats->nodes, stats->steps, stats->backtracks, stats->completed_components);
+        fprintf(statsf, "\"realized_black\": %" PRIu64 ", \"failed_black\": %" PRIu64 ", \"realized_red\": %" PRIu64 ", \"failed_red\": %" PRIu64 ", ",
+                stats->realized_black, stats->failed_black, stats->realized_red, stats->failed_red);
+        fprintf(statsf, "\"forced_moves\": %" PRIu64 ", \"red_sigma_graphs\": %" PRIu64 ", \"backjumps\": %" PRIu64 ", \"tt_lookups\": %" PRIu64 ", \"tt_hits\": %" PRIu64 ", \"perfect_phylogeny_nodes\": %" PRIu64 ", \"perfect_phylogeny\": %s, \"reduction\": %s, ",
+                stats->forced_moves, stats->red_sigma_graphs, stats->backjumps, stats->tt_lookups, stats->tt_hits, stats->perfect_phylogeny_nodes, stats->perfect_phylogeny ? "true" : "false", stats->reduction ? "true" : "false");
+        fprintf(statsf, "\"max_depth\": %" PRIu32 ", \"seconds\": %.6f, \"parse_seconds\": %.6f, ",
+                stats->max_depth, stats->seconds, parse_seconds);
+        fprintf(statsf, "\"connected_components_seconds\": %.6f, \"conflict_graph_seconds\": %.6f, \"cleanup_seconds\": %.6f}\n",
+                stats->phase_seconds[PHASE_CONNECTED_COMPONENTS], stats->phase_seconds[PHASE_CONFLICT_GRAPH],
+                stats->phase_seconds[PHASE_CLEANUP]);
+}
+
+/**
+   \brief an instance of a batch, with the expected cost of solving it
+*/
+typedef struct batch_entry_s {
+        uint64_t size;
+        uint32_t index;
+} batch_entry_s;
+
+static int
+larger_instance_first(const void* a, const void* b) {
+        const batch_entry_s* e1 = a;
+        const batch_entry_s* e2 = b;
+        if (e1->size != e2->size)
+                return (e1->size > e2->size) ? -1 : 1;
+        return (e1->index > e2->index) - (e1->index < e2->index);
+}
+
+/**
+   \brief solves the \c k instances of \c batch using \c jobs threads, and
+   writes the results to \c outf in input order. If \c statsf is not
+   \c NULL, the statistics are written to \c statsf, where \c first is the
+   number of the first instance of the batch and \c parse_seconds the time
+   spent reading each instance.
+
+   The instances are scheduled dynamically, starting from the largest ones
+   (that is, those with the largest matrix), so that a large instance does
+   not remain alone at the end of the batch.
+   Since the threads are created by OpenMP, each one must be registered with
+   the garbage collector before it allocates.
+   Each thread solves its instances in its own arena, which is reset after
+   each instance, and copies the results in another arena, which lasts until
+   the results have been written.
+*/
+static void
+solve_batch(state_s* batch, const double* parse_seconds, uint32_t k, uint32_t first, uint32_t jobs,
+            strategy_fn strategy, bool undo, uint32_t threads, bool greedy, FILE* outf, FILE* statsf) {
+        batch_entry_s* order = xmalloc((k + 1) * sizeof(batch_entry_s));
+        char** results = xmalloc((k + 1) * sizeof(char*));
+        search_stats_s* stats = xmalloc_atomic((k + 1) * sizeof(search_stats_s));
+        for (uint32_t i = 0; i < k; i++)
+                order[i] = (batch_entry_s) {
+                        .size = (uint64_t) batch[i].num_species_orig * batch[i].num_characters_orig,
+                        .index = i
+                };
+        qsort(order, k, sizeof(batch_entry_s), larger_instance_first);
+        arena_s** result_arenas = xmalloc(jobs * sizeof(arena_s*));
+#pragma omp parallel num_threads(jobs)
+        {
+                bool registered = gc_register_thread();
+                arena_s* solve_arena = arena_new();
+                arena_s* result_arena = arena_new();
+                result_arenas[omp_get_thread_num()] = result_arena;
+                arena_s* previous = arena_use(solve_arena);
+#pragma omp for schedule(dynamic, 1)
+                for (uint32_t i = 0; i < k; i++) {
+                        uint32_t j = order[i].index;
+                        char* result = solve_instance(batch + j, strategy, undo, threads, greedy, stats + j);
+                        arena_use(result_arena);
+                        results[j] = xcopy(result, strlen(result) + 1);
+                        arena_use(solve_arena);
+                        arena_reset(solve_arena);
+                }
+                arena_use(previous);
+                arena_delete(solve_arena);
+                gc_unregister_thread(registered);
+        }
+        for (uint32_t i = 0; i < k; i++) {
+                fprintf(outf, "%s\n", results[i]);
+                if (statsf != NULL)
+                        write_stats(statsf, first + i, parse_seconds[i], stats + i);
+        }
+        for (uint32_t i = 0; i < jobs; i++)
+                arena_delete(result_arenas[i]);
 }
 
 int main(int argc, char **argv) {
         static struct gengetopt_args_info args_info;
+        GC_INIT();
         int cmd_status = cmdline_parser(argc, argv, &args_info);
         if (cmd_status != 0)
                 error(4, 0, "Could not parse the command line\n");
         if (args_info.inputs_num < 1)
                 error(5, 0, "There is no input matrix to analyze\n");
+        if (args_info.jobs_arg < 1 || args_info.threads_arg < 1)
+                error(4, 0, "The number of jobs and of threads must be positive\n");
+        if (args_info.undo_given && args_info.threads_arg > 1)
+                error(4, 0, "The graphs cannot be shared among the levels of the decision tree with more than one thread\n");
+        if (args_info.table_size_arg < 0)
+                error(4, 0, "The size of the table cannot be negative\n");
+        if (args_info.restart_nodes_arg < 1 || args_info.max_restarts_arg < 0)
+                error(4, 0, "The number of nodes before a restart must be positive and the number of restarts cannot be negative\n");
+        if (args_info.time_limit_arg < 0 || args_info.node_limit_arg < 0 || args_info.backtrack_limit_arg < 0)
+                error(4, 0, "The limits of the search cannot be negative\n");
+        if (args_info.trace_depth_arg < 0 || args_info.trace_every_arg < 1)
+                error(4, 0, "The depth of the trace cannot be negative and the sampling of the nodes must be positive\n");
+        strategy_fn strategy = get_strategy(args_info.strategy_arg);
+        if (args_info.strategy_arg < 0 || strategy == NULL)
+                error(4, 0, "Unknown strategy %d\n", args_info.strategy_arg);
         start_logging(args_info);
         log_debug("cppp: start");
+        set_graph_representations(graph_representation(args_info.red_black_arg),
+                                  graph_representation(args_info.conflict_arg));
+        set_transposition_table_size((size_t) args_info.table_size_arg << 20);
+        set_restarts(restart_schedule(args_info.restart_arg), args_info.restart_nodes_arg,
+                     args_info.max_restarts_arg, args_info.seed_arg);
+        set_search_limits(args_info.time_limit_arg, args_info.node_limit_arg, args_info.backtrack_limit_arg);
         FILE* outf = fopen(args_info.output_arg, "w");
+        if (outf == NULL)
+                error(6, 0, "Could not open the output file\n");
+        FILE* statsf = NULL;
+        if (args_info.stats_given) {
+                statsf = fopen(args_info.stats_arg, "w");
+                if (statsf == NULL)
+                        error(6, 0, "Could not open the statistics file\n");
+                set_phase_timing(true);
+        }
+        FILE* tracef = NULL;
+        if (args_info.trace_given) {
+                tracef = fopen(args_info.trace_arg, "w");
+                if (tracef == NULL)
+                        error(6, 0, "Could not open the trace file\n");
+                trace_start(args_info.trace_depth_arg, args_info.trace_every_arg);
+        }
 
         instances_schema_s props = {
-                .file = NULL,
+                .reader = NULL,
                 .filename = args_info.inputs[0]
         };
-        state_s temp;
-        while (read_instance_from_filename(&props, &temp)) {
-/**
-   Notice that each character is realized at most twice (once positive and once
-   negative) and that each species can be declared null at most once.
-
-   Therefore each partial solution con contain at most 2m+n states.
+        if (args_info.convert_given) {
+                convert_instances(&props, outf, !strcmp(args_info.convert_arg, "binary"));
+                fclose(outf);
+                cmdline_parser_free(&args_info);
+                return 0;
+        }
+        bool undo = args_info.undo_given;
+        uint32_t jobs = args_info.jobs_arg;
+        uint32_t threads = args_info.threads_arg;
+        bool greedy = args_info.greedy_given;
+        if (jobs > 1 || threads > 1)
+                GC_allow_register_threads();
+/*
+  All the memory of an instance is allocated in an arena (if the program has
+  been built with arenas), which is reset when the instance has been solved.
 */
-                uint32_t maxdepth = temp.num_species_orig + 2 * temp.num_characters_orig + 1;
-                state_s states[maxdepth + 1];
-                for (uint32_t level = 0; level <= maxdepth; level++) {
-                        init_state(states + level, temp.num_species_orig, temp.num_characters_orig);
-                        log_debug("State #%d (max %d) = %p", level, maxdepth, states + level);
-                        log_debug("Initialized level %d", level);
-                        log_state(states + level);
+        arena_s* arena = arena_new();
+        if (jobs == 1) {
+                state_s temp;
+                search_stats_s stats;
+                arena_use(arena);
+                double start = monotonic_seconds();
+                for (uint32_t i = 1; read_instance_from_filename(&props, &temp); i++) {
+                        double parse_seconds = monotonic_seconds() - start;
+                        fprintf(outf, "%s\n", solve_instance(&temp, strategy, undo, threads, greedy, &stats));
+                        if (statsf != NULL)
+                                write_stats(statsf, i, parse_seconds, &stats);
+                        arena_reset(arena);
+                        start = monotonic_seconds();
                 }
-                log_debug("States initialized");
-                check_state(&temp);
-
-                copy_state(states + 0, &temp);
-                if (outf == NULL)
-                        error(6, 0, "Input file ended prematurely\n");
-                if (exhaustive_search(states, alphabetic, states[0].num_species + 2 * states[0].num_characters)) {
-                        log_debug("Writing solution");
-                        fprintf(outf, "%s\n", newick(states));
-                } else
-                        fprintf(outf, "Not found\n");
-                log_debug("Instance solved");
+                arena_use(NULL);
+        } else {
+/*
+  The instances are read in batches, so that the memory used does not depend
+  on the number of instances in the file.
+*/
+                uint32_t batch_size = INSTANCES_PER_JOB * jobs;
+                state_s* batch = xmalloc(batch_size * sizeof(state_s));
+                double* parse_seconds = xmalloc_atomic(batch_size * sizeof(double));
+                arena_use(arena);
+                uint32_t first = 1;
+                for (bool eof = false; !eof;) {
+                        uint32_t k = 0;
+                        for (double start = monotonic_seconds();
+                             k < batch_size && !(eof = !read_instance_from_filename(&props, batch + k));
+                             start = monotonic_seconds())
+                                parse_seconds[k++] = monotonic_seconds() - start;
+                        log_debug("cppp: solving a batch of %d instances", k);
+                        solve_batch(batch, parse_seconds, k, first, jobs, strategy, undo, threads, greedy, outf, statsf);
+                        arena_reset(arena);
+                        first += k;
+                }
+                arena_use(NULL);
         }
+        arena_delete(arena);
         fclose(outf);
+        if (statsf != NULL)
+                fclose(statsf);
+        if (tracef != NULL) {
+                trace_write(tracef);
+                fclose(tracef);
+        }
         cmdline_parser_free(&args_info);
         log_debug("END");
         return 0;
@@ -1,2 +1,4 @@
 #include "decision_tree.h"
+#include "reduction.h"
+#include "trace.h"
 #include "cmdline.h"
@@ -20,6 +20,153 @@
 */
 
 #include "decision_tree.h"
+#include "transposition_table.h"
+#include "trace.h"
+#include <sched.h>
+
+/**
+   \brief the budget of the nodes is checked at each node, while the clock
+   is read only once every \c BUDGET_CHECK_PERIOD nodes
+*/
+#define BUDGET_CHECK_PERIOD 64
+
+static size_t transposition_table_size = 0;
+
+void
+set_transposition_table_size(size_t max_bytes) {
+        transposition_table_size = max_bytes;
+}
+
+/**
+   \brief the restart schedule of each \c exhaustive_search, set by \c
+   set_restarts
+*/
+static struct {
+        uint32_t schedule;
+        uint32_t base_nodes;
+        uint32_t max_restarts;
+        uint64_t seed;
+} restarts = { .schedule = RESTART_NONE };
+
+void
+set_restarts(uint32_t schedule, uint32_t base_nodes, uint32_t max_restarts, uint64_t seed) {
+        restarts.schedule = schedule;
+        restarts.base_nodes = base_nodes;
+        restarts.max_restarts = max_restarts;
+        restarts.seed = seed;
+}
+
+/**
+   \brief the budget of each search, set by \c set_search_limits. A limit
+   equal to 0 is not checked.
+*/
+static struct {
+        double seconds;
+        uint64_t nodes;
+        uint64_t backtracks;
+} limits;
+
+void
+set_search_limits(double seconds, uint64_t nodes, uint64_t backtracks) {
+        limits.seconds = seconds;
+        limits.nodes = nodes;
+        limits.backtracks = backtracks;
+}
+
+/**
+   \brief \c true iff a search started at time \c start, which has created
+   \c nodes nodes and made \c backtracks backtracks, has exhausted its
+   budget. \c steps is the number of calls of \c next_node, and the clock
+   is read only when it is a multiple of \c BUDGET_CHECK_PERIOD.
+*/
+static bool
+budget_exhausted(uint64_t nodes, uint64_t backtracks, double start, uint64_t steps) {
+        if (limits.nodes > 0 && nodes >= limits.nodes)
+                return true;
+        if (limits.backtracks > 0 && backtracks >= limits.backtracks)
+                return true;
+        return (limits.seconds > 0 && steps % BUDGET_CHECK_PERIOD == 0 && monotonic_seconds() - start >= limits.seconds);
+}
+
+/**
+   \struct search_context_s
+   \brief what is needed to create the nodes of a decision tree, besides
+   the states.
+
+   \c table is the transposition table, or \c NULL. If \c randomize is
+   \c true, the queue of each node is shuffled before the strategy orders it,
+   so that ties are broken at random, and \c random is the state of the
+   generator. \c stats counts the work done with the context, and \c
+   traced is \c true iff the current call of \c next_node is recorded in
+   the trace. \c start is the time when the search has started, to check
+   its budget.
+
+   If \c conflicts is not \c NULL, the search backjumps (see \c backjump),
+   and \c conflicts contains, for each level, a bitmap of \c
+   conflict_words words with the vertices of the red-black graph that are
+   involved in the failures of the subtrees of the level.
+*/
+typedef struct search_context_s {
+        strategy_fn strategy;
+        transposition_table_s* table;
+        bool randomize;
+        uint64_t random;
+        bitmap_word* conflicts;
+        uint32_t conflict_words;
+        search_stats_s stats;
+        double start;
+        bool traced;
+} search_context_s;
+
+/**
+   \brief adds (if \c sign is 1) or subtracts (if \c sign is -1) the time
+   spent so far by the calling thread in each phase to \c stats, so that
+   \c stats gets the time spent between the two calls.
+*/
+static void
+add_phase_times(search_stats_s *stats, double sign) {
+        double seconds[NUM_PHASES];
+        phase_times(seconds);
+        for (uint32_t p = 0; p < NUM_PHASES; p++)
+                stats->phase_seconds[p] += sign * seconds[p];
+}
+
+/**
+   \brief adds the counters of \c src to \c dst
+*/
+static void
+merge_stats(search_stats_s *dst, const search_stats_s *src) {
+        dst->nodes += src->nodes;
+        dst->steps += src->steps;
+        dst->backtracks += src->backtracks;
+        dst->completed_components += src->completed_components;
+        dst->realized_black += src->realized_black;
+        dst->failed_black += src->failed_black;
+        dst->realized_red += src->realized_red;
+        dst->failed_red += src->failed_red;
+        dst->perfect_phylogeny_nodes += src->perfect_phylogeny_nodes;
+        dst->forced_moves += src->forced_moves;
+        dst->red_sigma_graphs += src->red_sigma_graphs;
+        dst->backjumps += src->backjumps;
+        dst->tt_lookups += src->tt_lookups;
+        dst->tt_hits += src->tt_hits;
+        if (src->max_depth > dst->max_depth)
+                dst->max_depth = src->max_depth;
+        for (uint32_t p = 0; p < NUM_PHASES; p++)
+                dst->phase_seconds[p] += src->phase_seconds[p];
+}
+
+/**
+   \brief the next pseudorandom number of the splitmix64 generator, whose
+   state is \c *random
+*/
+static uint64_t
+next_random(uint64_t* random) {
+        uint64_t z = (*random += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+}
 
 /**
    \brief prints a dump of the sequence of characters realized
@@ -49,20 +196,27 @@ level_completed(const state_s * stp) {
 /**
    modifies the current state \c stp so that the next available
    character is computed and the list \c tried_characters and \c
-   character_queue are updated
+   character_queue are updated.
+
+   An inactive character that is a duplicate of a character already tried
+   is skipped, and -1 is returned if only duplicates are left.
 */
 static uint32_t
 next_character(state_s *stp) {
         log_debug("next_character: stp=%p", stp);
         log_state_lists(stp);
-        if (stp->character_queue_size > 0 ) {
-/* we have found a character to try */
+        while (stp->character_queue_size > 0 ) {
                 uint32_t c = stp->character_queue[0];
-                stp->tried_characters[stp->tried_characters_size] = c;
-                stp->tried_characters_size += 1;
                 stp->character_queue_size -= 1;
                 for (uint32_t i = 0; i < stp->character_queue_size; i++)
                         stp->character_queue[i] = stp->character_queue[i+1];
+                if (stp->colors[c] == BLACK && stp->character_representative[c] != c) {
+                        log_debug("next_character: %d is a duplicate of %d", c, stp->character_representative[c]);
+                        continue;
+                }
+/* we have found a character to try */
+                stp->tried_characters[stp->tried_characters_size] = c;
+                stp->tried_characters_size += 1;
                 log_debug("next_character: %d", c);
                 log_debug("next_character: end");
                 log_state_lists(stp);
@@ -71,14 +225,92 @@ next_character(state_s *stp) {
         return -1;
 }
 
+/**
+   \brief initializes the state \c stp of a level of the decision tree, if
+   it has not been initialized yet, that is if its red-black graph is \c
+   NULL. It shares the graphs of \c root if \c root has an undo trail.
+*/
+static void
+init_level(state_s *stp, state_s *root) {
+        if (stp->red_black != NULL)
+                return;
+        log_debug("init_level: %p", stp);
+        if (root->trail != NULL)
+                init_shared_state(stp, root);
+        else
+                init_state(stp, root->num_species_orig, root->num_characters_orig);
+}
+
+/**
+   \brief a character whose realization at the node \c stp is forced, or
+   -1 if there is none: an active character that can be freed, which
+   \c smallest_component puts first in the queue, or an inactive character
+   adjacent to all species of the current component, which can be realized
+   safely.
+*/
+static uint32_t
+forced_character(const state_s *stp) {
+        if (stp->character_queue_size == 0)
+                return -1;
+        if (stp->colors[stp->character_queue[0]] != BLACK)
+                return stp->character_queue[0];
+        uint32_t n = stp->num_species_orig;
+        uint32_t label = stp->connected_components[n + stp->character_queue[0]];
+        for (uint32_t i = 0; i < stp->character_queue_size; i++) {
+                uint32_t c = stp->character_queue[i];
+                if (stp->character_representative[c] == c &&
+                    graph_degree(stp->red_black, n + c) == stp->component_species[label])
+                        return c;
+        }
+        return -1;
+}
+
 /**
    \brief set up the new node of the decision tree
+
+   The inactive characters of the queue are ordered by the strategy, while
+   an active character that can be freed remains the first of the queue.
+   If a character is forced (see \c forced_character), it is the only
+   character of the queue, therefore the node is not a choice point. When
+   the forced character is inactive, the current component might have a
+   perfect phylogeny, whose root is a character adjacent to all species of
+   the component: then the root is forced, and the component is solved by
+   the following nodes without backtracking.
 */
 static void
-init_node(state_s *stp, strategy_fn get_characters_to_realize) {
+init_node(state_s *stp, search_context_s *context) {
         log_debug("init_node");
+        context->stats.nodes++;
         stp->tried_characters_size = 0;
         smallest_component(stp);
+        uint32_t forced = forced_character(stp);
+        if (forced != -1 && stp->colors[forced] == BLACK) {
+                uint32_t root = perfect_phylogeny_root(stp);
+                if (root != UINT32_MAX) {
+                        log_debug("init_node: perfect phylogeny with root %d", root);
+                        context->stats.perfect_phylogeny_nodes++;
+                        forced = root;
+                }
+        }
+        if (forced != -1) {
+                log_debug("init_node: %d is forced", forced);
+                stp->character_queue[0] = forced;
+                stp->character_queue_size = 1;
+                log_state(stp);
+                return;
+        }
+        uint32_t first = (stp->character_queue_size > 0 && stp->colors[stp->character_queue[0]] != BLACK) ? 1 : 0;
+        uint32_t *chars = stp->character_queue + first;
+        uint32_t num_chars = stp->character_queue_size - first;
+        if (context->randomize)
+                for (uint32_t i = num_chars; i > 1; i--) {
+                        uint32_t j = next_random(&context->random) % i;
+                        uint32_t c = chars[i - 1];
+                        chars[i - 1] = chars[j];
+                        chars[j] = c;
+                }
+        context->strategy(stp, chars, num_chars);
+        log_array_uint32_t("character_queue", stp->character_queue, stp->character_queue_size);
         log_state(stp);
         log_debug("init_node:end");
 }
@@ -100,26 +332,202 @@ static bool
 component_borders(state_s* states, uint32_t root_level, uint32_t leaf_level) {
         state_s* root = states + root_level;
         state_s* leaf = states + leaf_level;
-        bool* solved = bool_array_difference(root->characters, leaf->characters, root->num_characters_orig);
-        bool found = bool_array_equal(solved, (root->current_component) + root->num_species_orig, root->num_characters_orig);
-        if (!found)
-                return false;
+        for (uint32_t c = 0; c < root->num_characters_orig; c++)
+                if ((bitmap_get_bit(root->characters, c) && !bitmap_get_bit(leaf->characters, c)) !=
+                    bitmap_get_bit(root->current_component, root->num_species_orig + c))
+                        return false;
         for (uint32_t l = root_level + 1; l <= leaf_level; l++)
-                if (!bool_array_includes(root->current_component , (states + l)->current_component, root->red_black->num_vertices))
+                if (!bitmap_includes((states + l)->current_component, root->current_component, root->red_black->num_vertices))
                         return false;
         return true;
 }
 
+/**
+   \brief counts a backtrack from \c level to \c target, which is returned
+*/
+static uint32_t
+backtrack(search_context_s *context, uint32_t level, uint32_t target) {
+        context->stats.backtracks++;
+        if (context->traced)
+                trace_event(TRACE_BACKTRACK, monotonic_seconds(), -1, level, (int32_t) target, 0, 0);
+        return target;
+}
+
+/**
+   \brief the vertices involved in the failures of the subtrees of the
+   level \c level
+*/
+static bitmap_word*
+level_conflicts(search_context_s *context, uint32_t level) {
+        return context->conflicts + (size_t) level * context->conflict_words;
+}
+
+/**
+   \brief backtracks from the level \c level, whose queue is exhausted.
+
+   Without \c context->conflicts, the search backtracks to \c backtrack_level.
+   Otherwise, the failure of the node involves the vertices of its current
+   component and the vertices involved in the failures of its subtrees: the
+   subgraph that they induce has no successful reduction, and neither has
+   any red-black graph that contains it. A realization changes only the
+   edges of the realized character, therefore a decision whose character
+   is not among those vertices has not changed that subgraph, and all its
+   alternatives fail in the same way. The search goes back along the chain
+   of the \c backtrack_level to the first level whose character is involved,
+   skipping the others, and the vertices are added to the vertices involved
+   in the failures of that level. If no level is left, the instance has no
+   solution.
+
+   The nodes of the levels skipped have no solution, hence they are stored
+   in the transposition table, as the exhausted nodes.
+*/
+static uint32_t
+backjump(state_s *states, uint32_t level, search_context_s *context) {
+        state_s *current = states + level;
+        if (context->conflicts == NULL)
+                return backtrack(context, level, current->backtrack_level);
+        bitmap_word *conflicts = level_conflicts(context, level);
+        bitmap_or_words(conflicts, current->current_component, context->conflict_words);
+        uint32_t target = current->backtrack_level;
+        bool skipped = false;
+        for (; target != -1 && !bitmap_get_bit(conflicts, current->num_species_orig + (states + target)->realize);
+             target = (states + target)->backtrack_level) {
+                state_s *stp = states + target;
+                skipped = skipped || !level_completed(stp);
+                if (context->table != NULL) {
+                        if (stp->trail != NULL)
+                                graph_trail_undo(stp->trail, stp->trail_mark);
+                        transposition_table_store(context->table, stp, target);
+                }
+        }
+        if (skipped) {
+                log_debug("backjump: from %d to %d instead of %d", level, target, current->backtrack_level);
+                context->stats.backjumps++;
+        }
+        if (target != -1)
+                bitmap_or_words(level_conflicts(context, target), conflicts, context->conflict_words);
+        return backtrack(context, level, target);
+}
+
+/**
+   \brief realizes the character \c realize of the level \c level in the
+   level \c level + 1, counting and tracing the realization
+
+   \return \c true if the realization has been successful and it has not
+   created a red Σ-graph (see \c red_sigma_graph_with). Since a red-black
+   graph with a red Σ-graph has no successful reduction, the new node would
+   be the root of a subtree without solutions, which is pruned as if the
+   realization had failed.
+*/
+static bool
+realize_level(state_s *states, uint32_t level, search_context_s *context) {
+        state_s *current = states + level;
+        state_s *next = states + (level + 1);
+        init_level(next, states + 0);
+        log_debug("realize_level: realizing level=%d current->realize=%d %p %p", level, current->realize, next, current);
+        bool inactive = (current->colors[current->realize] == BLACK);
+        double start = context->traced ? monotonic_seconds() : 0.0;
+        bool status = realize_character(next, current);
+        log_debug("realize_level: result of realizing level=%d current->realize=%d outcome=%d", level, current->realize, status);
+        if (context->traced)
+                trace_event(TRACE_REALIZE, start, monotonic_seconds() - start, level, current->realize, inactive, status);
+        if (inactive)
+                status ? context->stats.realized_black++ : context->stats.failed_black++;
+        else
+                status ? context->stats.realized_red++ : context->stats.failed_red++;
+        if (status && inactive && red_sigma_graph_with(next, current->realize)) {
+                log_debug("realize_level: level=%d current->realize=%d creates a red sigma-graph", level, current->realize);
+                context->stats.red_sigma_graphs++;
+                return false;
+        }
+        return status;
+}
+
+/**
+   \brief creates the node at the level \c level + 1, after that the
+   character of the level \c level has been successfully realized
+
+   \return the level where the search continues: \c level + 1, unless the
+   new node is a known failure of the transposition table, in which case
+   the search backtracks.
+*/
+static uint32_t
+enter_node(state_s *states, uint32_t level, search_context_s *context) {
+        transposition_table_s* table = context->table;
+        state_s *current = states + level;
+        state_s *next = states + (level + 1);
+        if (level + 1 > context->stats.max_depth)
+                context->stats.max_depth = level + 1;
+        /* First check if we have resolved the whole instance */
+        if (next->num_species == 0) {
+                log_debug("enter_node: Solution found");
+                return(level + 1);
+        }
+
+        /* Since we had realized a character, we move to a
+           deeper level of the decision tree. */
+        log_debug("enter_node: LEVEL. Go to level: %d", level + 1);
+        if (next->trail != NULL)
+                next->trail_mark = next->trail->size;
+        if (context->conflicts != NULL)
+                memset(level_conflicts(context, level + 1), 0, context->conflict_words * sizeof(bitmap_word));
+        init_node(next, context);
+
+        /* Since the realization of the negated characters are forced, we backtrack to the lowest level of the
+           decision tree where the operation is the realization of an inactive character.
+
+           In fact, this implies that we permute over all realization of inactive characters, instead of the
+           naive permutation of all possible characters.
+        */
+        for (next->backtrack_level = level; (states + next->backtrack_level)->operation != 1; next->backtrack_level--) ;
+
+        if (level_completed(current)) {
+                log_debug("enter_node: connected component completed");
+/* In this case we have resolved a connected component of the red-black graph. Find the level of the decision tree where
+ * we have started resolving such connected component.
+ * It is equal to the topmost level whose current_component includes the original species and all characters that are not current. */
+                for (uint32_t blevel = 0; blevel < level; blevel++)
+                        if (component_borders(states, blevel, level + 1)) {
+                                context->stats.completed_components++;
+                                if (context->traced)
+                                        trace_event(TRACE_COMPONENT, monotonic_seconds(), -1, level + 1, blevel, 0, 0);
+                                next->backtrack_level = (blevel > 0) ? (states + blevel - 1)->backtrack_level : -1;
+                                log_decisions(states, level);
+                                log_debug("Preparing backtrack to level %d from %d (level=%d)", blevel - 1, level + 1, level);
+                                for (uint32_t l = blevel; l <= level; l++) {
+                                        log_debug("Level=%d (%d-%d)", l, blevel, level);
+                                        log_bitmap("current_component", (states + l)->current_component, (states + blevel)->red_black->num_vertices);
+                                        log_bitmap("characters", (states + l)->characters, (states + blevel)->num_characters_orig);
+                                }
+                                log_debug("Next state");
+                                log_state(next);
+                                log_debug("Backtracked state");
+                                log_state(states + blevel);
+                                break;
+                        }
+        }
+        if (table != NULL && transposition_table_lookup(table, next)) {
+                log_debug("enter_node: end. Known failure. Backtrack to level: %d from %d", next->backtrack_level, level + 1);
+/* The whole state has no solution, which involves all vertices */
+                if (context->conflicts != NULL)
+                        memset(level_conflicts(context, level + 1), 0xff, context->conflict_words * sizeof(bitmap_word));
+                return backjump(states, level + 1, context);
+        }
+        log_debug("enter_node: end. LEVEL. Move to level: %d", level + 1);
+        return (level + 1);
+}
+
 /**
    \brief computes the next node of the decision tree
 
    \param states: the set of states, since the decision tree can move to the
    next level or to get back to the previous level
    \param level: the current level
-   \param strategy_fn: a pointer to the function encoding the order of the
-   characters that we will try in the current level
+   \param context: the strategy encoding the order of the characters that we
+   will try in the new level, and the transposition table
 
-   \return the new level. It can differ from the input level at most by 1.
+   \return the new level. It is smaller than \c level after a backtrack, and
+   it can be larger than \c level + 1 when some moves are propagated.
 
    We keep track of the lists of \c tried_character (that is the characters that
    we have already tried to realized in the current level) and of \c
@@ -130,98 +538,629 @@ component_borders(state_s* states, uint32_t root_level, uint32_t leaf_level) {
    \c character_queue contains only inactive characters, with the possible exception of the first character in the queue
    which can be active if it can be freed (i.e. if it is adjacent to all species in its connected component.
    The function \c smallest_component must take care of setting \c character_queue accordingly.
+
+   After a successful realization, the moves that are not choice points are
+   propagated: while the new node has a single character in its queue (in
+   particular when the character is forced), the character is realized at
+   once, and the search moves to the following level. Each of those moves
+   has its own level, so that \c newick sees it, and its queue is empty, so
+   that a backtrack goes through it without trying anything else. The
+   propagation stops as soon as the budget of the search is exhausted, so
+   that a long chain of forced moves does not exceed it; the moves left are
+   propagated by the next call.
+
+   If \c context->table is not \c NULL, a node whose queue is exhausted has no
+   solution: all its children have been visited and the backtracks inside
+   its subtree did not skip it, so it is stored in \c table. A new node that
+   is found in \c table is not visited, and we backtrack as if its queue
+   was empty.
 */
 static uint32_t
-next_node(state_s *states, uint32_t level, strategy_fn get_characters_to_realize) {
+next_node(state_s *states, uint32_t level, search_context_s *context) {
+        transposition_table_s* table = context->table;
         log_debug("next_node: level=%d", level);
+        context->stats.steps++;
         state_s *current = states + level;
         log_state(current);
         log_decisions(states, level);
 
+        /* With shared graphs, the graphs can contain the changes of an
+           unsuccessful realization or of a deeper level of the decision tree */
+        if (current->trail != NULL)
+                graph_trail_undo(current->trail, current->trail_mark);
         if (level_completed(current)) {
                 /* it is not possible to extend the solution. We have
                    to backtrack */
                 log_debug("next_node: end. LEVEL. Backtrack to level: %d from %d", current->backtrack_level, level);
-                return (current->backtrack_level);
+                if (table != NULL)
+                        transposition_table_store(table, current, level);
+                return backjump(states, level, context);
         }
         log_debug("Inside next_node");
         current->realize = next_character(current);
+        if (current->realize == -1) {
+                log_debug("next_node: end. Only duplicates left. Backtrack to level: %d from %d", current->backtrack_level, level);
+                if (table != NULL)
+                        transposition_table_store(table, current, level);
+                return backjump(states, level, context);
+        }
         assert(current->realize <= current->num_characters_orig);
-        state_s *next = states + (level + 1);
-        log_debug("next_node: realizing level=%d current->realize=%d %p %p", level, current->realize, next, current);
-        bool status = realize_character(next, current);
-        log_debug("next_node: result of realizing level=%d current->realize=%d outcome=%d", level, current->realize, status);
-        if (status) {
-                /* The realization has been successful.
-                   First check if we have resolved the whole instance */
-                if (next->num_species == 0) {
-                        log_debug("next_node: Solution found");
-                        return(level + 1);
+        if (!realize_level(states, level, context)) {
+/***********************************************/
+/* The next solution is not feasible        */
+/***********************************************/
+                log_debug("next_node: end. LEVEL. Stay at level: %d", level);
+                return (level);
+        }
+        uint32_t target = enter_node(states, level, context);
+        while (target == level + 1 && (states + target)->num_species > 0 && (states + target)->character_queue_size == 1) {
+                if (budget_exhausted(context->stats.nodes, context->stats.backtracks, context->start, context->stats.steps))
+                        return target;
+                level = target;
+                current = states + level;
+                current->realize = next_character(current);
+                if (current->realize == -1)
+                        return level;
+                log_debug("next_node: propagating %d at level %d", current->realize, level);
+                context->stats.forced_moves++;
+/* If the realization fails, the queue is empty and the next call backtracks */
+                if (!realize_level(states, level, context))
+                        return level;
+                target = enter_node(states, level, context);
+        }
+        return target;
+}
+
+/**
+   \brief calls \c next_node, recording the call in the trace if it is
+   sampled
+*/
+static uint32_t
+traced_next_node(state_s *states, uint32_t level, search_context_s *context) {
+        context->traced = trace_sampled(level, context->stats.steps);
+        if (!context->traced)
+                return next_node(states, level, context);
+        double start = monotonic_seconds();
+        uint32_t next = next_node(states, level, context);
+        trace_event(TRACE_NEXT_NODE, start, monotonic_seconds() - start, level, 0, 0, 0);
+        return next;
+}
+
+/**
+   \brief the \c i-th term (starting from 1) of the Luby sequence 1, 1, 2, 1,
+   1, 2, 4, 1, 1, 2, ...
+*/
+static uint64_t
+luby(uint64_t i) {
+        uint32_t k = 1;
+        for (; (1ULL << k) - 1 < i; k++) ;
+        if (i == (1ULL << k) - 1)
+                return 1ULL << (k - 1);
+        return luby(i - (1ULL << (k - 1)) + 1);
+}
+
+/**
+   \brief the maximum number of nodes of the run \c run of a search, or 0 if
+   the run is not limited. The run after the last restart is not limited, so
+   that the search remains complete.
+*/
+static uint64_t
+run_limit(uint32_t run) {
+        if (restarts.schedule == RESTART_NONE || run >= restarts.max_restarts)
+                return 0;
+        if (restarts.schedule == RESTART_LUBY)
+                return restarts.base_nodes * luby(run + 1);
+        uint64_t limit = restarts.base_nodes;
+        for (uint32_t i = 0; i < run; i++)
+                limit += limit / 2;
+        return limit;
+}
+
+uint32_t
+exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth, search_stats_s *stats) {
+        log_debug("exhaustive_search: init");
+/*
+  The states without solution do not depend on the order of the
+  characters, therefore the transposition table is kept across restarts.
+*/
+        search_context_s context = {
+                .strategy = strategy,
+                .table = (transposition_table_size > 0) ? transposition_table_new(transposition_table_size) : NULL,
+                .randomize = (restarts.schedule != RESTART_NONE),
+                .random = restarts.seed,
+                .conflict_words = BITMAP_NWORDS((states + 0)->red_black->num_vertices)
+        };
+        context.conflicts = xmalloc_atomic((size_t) (max_depth + 1) * context.conflict_words * sizeof(bitmap_word));
+        double start = monotonic_seconds();
+        context.start = start;
+        add_phase_times(&context.stats, -1);
+        cleanup(states + 0);
+        update_connected_components(states + 0);
+        if ((states + 0)->trail != NULL)
+                (states + 0)->trail_mark = (states + 0)->trail->size;
+        log_debug("exhaustive_search: end init");
+        uint32_t result = SEARCH_NOT_FOUND;
+        uint32_t run = 0;
+        for (bool completed = false; !completed; run++) {
+                uint64_t limit = run_limit(run);
+                uint64_t run_start = context.stats.nodes;
+                if ((states + 0)->trail != NULL)
+                        graph_trail_undo((states + 0)->trail, (states + 0)->trail_mark);
+                memset(level_conflicts(&context, 0), 0, context.conflict_words * sizeof(bitmap_word));
+                init_node(states + 0, &context);
+                (states + 0)->backtrack_level = -1;
+                completed = true;
+                for(uint32_t level = 0; level != -1; level = traced_next_node(states, level, &context)) {
+                        log_debug("exhaustive_search: level %d", level);
+                        log_decisions(states, level);
+                        log_state(states + level);
+                        assert(level <= max_depth);
+                        if ((states + level)->num_species == 0) {
+                                log_debug("exhaustive_search: solution found");
+                                result = SEARCH_FOUND;
+                                break;
+                        }
+                        if (budget_exhausted(context.stats.nodes, context.stats.backtracks, start, context.stats.steps)) {
+                                log_debug("exhaustive_search: budget exhausted");
+                                result = SEARCH_UNKNOWN;
+                                break;
+                        }
+                        if (limit > 0 && context.stats.nodes - run_start >= limit) {
+                                log_debug("exhaustive_search: restart after %" PRIu64 " nodes", context.stats.nodes - run_start);
+                                completed = false;
+                                break;
+                        }
                 }
+        }
+        if (restarts.schedule != RESTART_NONE)
+                log_info("exhaustive_search: %u runs, %" PRIu64 " nodes", run, context.stats.nodes);
+        if (context.table != NULL) {
+                log_transposition_table(context.table);
+                context.stats.tt_lookups = context.table->lookups;
+                context.stats.tt_hits = context.table->hits;
+        }
+        add_phase_times(&context.stats, 1);
+        context.stats.outcome = result;
+        context.stats.seconds = monotonic_seconds() - start;
+        if (trace_enabled())
+                trace_event(TRACE_SEARCH, start, context.stats.seconds, result, context.stats.nodes, 0, 0);
+        if (stats != NULL)
+                *stats = context.stats;
+        log_debug("exhaustive_search: result %d", result);
+        return result;
+}
 
-                /* Since we had realized a character, we move to a
-                   deeper level of the decision tree. */
-                log_debug("next_node: LEVEL. Go to level: %d", level + 1);
-                init_node(next, get_characters_to_realize);
+/**
+   \struct search_cut_s
+   \brief a backtrack of a worker of the parallel search from \c level to
+   \c target, with the ids of the nodes of the path from the root to \c level.
 
-                /* Since the realization of the negated characters are forced, we backtrack to the lowest level of the
-                   decision tree where the operation is the realization of an inactive character.
+   In the sequential search such a backtrack skips all characters left at the
+   levels \c target + 1 ... \c level - 1 of the path. Therefore a worker that
+   is solving one of those characters, or one of their descendants, stops.
+*/
+typedef struct search_cut_s {
+        uint32_t worker;
+        uint32_t target;
+        uint32_t level;
+        uint64_t *path;
+} search_cut_s;
 
-                   In fact, this implies that we permute over all realization of inactive characters, instead of the
-                   naive permutation of all possible characters.
-                */
-                for (next->backtrack_level = level; (states + next->backtrack_level)->operation != 1; next->backtrack_level--) ;
+/**
+   \struct search_worker_s
+   \brief a worker of the parallel search.
 
-                if (level_completed(current)) {
-                        log_debug("next_node: connected component completed");
-/* In this case we have resolved a connected component of the red-black graph. Find the level of the decision tree where
- * we have started resolving such connected component.
- * It is equal to the topmost level whose current_component includes the original species and all characters that are not current. */
-                        for (uint32_t blevel = 0; blevel < level; blevel++)
-                                if (component_borders(states, blevel, level + 1)) {
-                                        next->backtrack_level = (blevel > 0) ? (states + blevel - 1)->backtrack_level : -1;
-                                        log_decisions(states, level);
-                                        log_debug("Preparing backtrack to level %d from %d (level=%d)", blevel - 1, level + 1, level);
-                                        for (uint32_t l = blevel; l <= level; l++) {
-                                                log_debug("Level=%d (%d-%d)", l, blevel, level);
-                                                log_array_bool("current_component", (states + l)->current_component, (states + blevel)->red_black->num_vertices);
-                                                log_array_bool("characters", (states + l)->characters, (states + blevel)->num_characters_orig);
-                                        }
-                                        log_debug("Next state");
-                                        log_state(next);
-                                        log_debug("Backtracked state");
-                                        log_state(states + blevel);
-                                        break;
-                                }
+   Each worker has its own array \c states and solves the subtree of the
+   decision tree rooted at the character in the queue of the level \c root.
+   \c path contains the id of the node of the decision tree stored in each
+   level up to \c level, and \c stolen[l] is true iff another worker has
+   stolen a character of the level \c l.
+
+   \c lock protects \c level, \c active and the levels of \c states above \c
+   level, which can be read and modified by the thieves.
+*/
+typedef struct search_worker_s {
+        state_s *states;
+        uint64_t *path;
+        bool *stolen;
+        uint32_t root;
+        uint32_t level;
+        uint32_t seen_cuts;
+        bool active;
+        omp_lock_t lock;
+        arena_s *arena;
+} search_worker_s;
+
+/**
+   \struct search_s
+   \brief the data shared by all workers of the parallel search.
+
+   The search is \c done when a worker has found a solution, or when the
+   budget has been exhausted, in which case \c unknown is \c true. \c nodes
+   and \c backtracks are the sums of the counters of all workers, updated
+   at each step to check the budget, while \c stats gets all counters of
+   each worker when it ends.
+*/
+typedef struct search_s {
+        search_worker_s *workers;
+        uint32_t num_workers;
+        uint32_t max_depth;
+        strategy_fn strategy;
+        uint32_t active;
+        uint64_t next_id;
+        bool done;
+        bool unknown;
+        uint32_t winner;
+        uint64_t nodes;
+        uint64_t backtracks;
+        double start;
+        search_stats_s stats;
+        search_cut_s **cuts;
+        uint32_t num_cuts;
+        uint32_t cuts_capacity;
+        omp_lock_t cuts_lock;
+} search_s;
+
+static bool
+search_done(search_s *sp) {
+        bool done;
+#pragma omp atomic read
+        done = sp->done;
+        return done;
+}
+
+static uint64_t
+new_node_id(search_s *sp) {
+        uint64_t id;
+#pragma omp atomic capture
+        id = sp->next_id++;
+        return id;
+}
+
+/**
+   \brief the worker \c w stops, since its subtree has been completely
+   visited. It requires the lock of \c w.
+*/
+static void
+finish_task(search_s *sp, search_worker_s *w) {
+        w->active = false;
+#pragma omp atomic
+        sp->active--;
+}
+
+/**
+   \brief records that the worker \c id has backtracked from \c level to \c
+   target.
+*/
+static void
+publish_cut(search_s *sp, uint32_t id, uint32_t level, uint32_t target) {
+        search_worker_s *w = sp->workers + id;
+        search_cut_s *cut = xmalloc(sizeof(search_cut_s));
+        cut->worker = id;
+        cut->target = target;
+        cut->level = level;
+        cut->path = xcopy(w->path, (level + 1) * sizeof(uint64_t));
+        omp_set_lock(&sp->cuts_lock);
+        if (sp->num_cuts == sp->cuts_capacity) {
+/* The old array is not freed, since the workers can still read it */
+                sp->cuts_capacity = 2 * sp->cuts_capacity + 16;
+                search_cut_s **cuts = xmalloc(sp->cuts_capacity * sizeof(search_cut_s*));
+                if (sp->num_cuts > 0)
+                        memcpy(cuts, sp->cuts, sp->num_cuts * sizeof(search_cut_s*));
+                sp->cuts = cuts;
+        }
+        sp->cuts[sp->num_cuts] = cut;
+#pragma omp atomic write
+        sp->num_cuts = sp->num_cuts + 1;
+        omp_unset_lock(&sp->cuts_lock);
+        log_debug("publish_cut: worker %d from level %d to %d", id, level, target);
+}
+
+/**
+   \brief true iff the current node of the worker \c w is skipped by \c cut,
+   that is if it is a descendant of a character left at one of the levels \c
+   target + 1 ... \c level - 1 of the path of \c cut, or if it is one of the
+   nodes of those levels.
+*/
+static bool
+cut_applies(const search_worker_s *w, const search_cut_s *cut) {
+        uint32_t first = cut->target + 1;
+        uint32_t last = (w->level < cut->level - 1) ? w->level : cut->level - 1;
+        if (first > last || w->path[first] != cut->path[first])
+                return false;
+        uint32_t d = first;
+        while (d < last && w->path[d + 1] == cut->path[d + 1])
+                d++;
+        if (d == w->level)
+                return true;
+        return w->path[d + 1] != cut->path[d + 1];
+}
+
+/**
+   \brief applies the cuts published since the last call, moving the worker
+   \c id to the target of a cut that applies, or stopping it if the target is
+   above its root.
+
+   Returns \c false iff the worker has stopped.
+*/
+static bool
+apply_cuts(search_s *sp, uint32_t id) {
+        search_worker_s *w = sp->workers + id;
+        uint32_t num_cuts;
+#pragma omp atomic read
+        num_cuts = sp->num_cuts;
+        if (num_cuts == w->seen_cuts)
+                return true;
+        omp_set_lock(&sp->cuts_lock);
+        search_cut_s **cuts = sp->cuts;
+        omp_unset_lock(&sp->cuts_lock);
+        omp_set_lock(&w->lock);
+        for (; w->active && w->seen_cuts < num_cuts; w->seen_cuts++) {
+                search_cut_s *cut = cuts[w->seen_cuts];
+                if (cut->worker == id || !cut_applies(w, cut))
+                        continue;
+                log_debug("apply_cuts: worker %d at level %d, cut to %d", id, w->level, cut->target);
+                if (cut->target == -1 || cut->target < w->root)
+                        finish_task(sp, w);
+                else
+                        w->level = cut->target;
+        }
+        w->seen_cuts = num_cuts;
+        bool active = w->active;
+        omp_unset_lock(&w->lock);
+        return active;
+}
+
+/**
+   \brief tries to steal from the worker \c v a character of one of its
+   levels above the current one, starting from the shallowest level, so that
+   the largest subtrees are stolen.
+   The thief \c id copies all the levels up to the one of the character.
+
+   It requires the lock of \c v.
+*/
+static bool
+steal_character(search_s *sp, uint32_t id, uint32_t v) {
+        search_worker_s *w = sp->workers + id;
+        search_worker_s *victim = sp->workers + v;
+        for (uint32_t l = victim->root; l < victim->level; l++) {
+                state_s *stp = victim->states + l;
+                for (uint32_t k = stp->character_queue_size; k > 0; k--) {
+                        uint32_t c = stp->character_queue[k - 1];
+                        if (stp->colors[c] == BLACK && stp->character_representative[c] != c)
+                                continue;
+                        log_debug("steal_character: worker %d steals %d at level %d from %d", id, c, l, v);
+                        stp->character_queue_size -= 1;
+                        for (uint32_t i = k - 1; i < stp->character_queue_size; i++)
+                                stp->character_queue[i] = stp->character_queue[i + 1];
+                        victim->stolen[l] = true;
+                        for (uint32_t i = 0; i <= l; i++) {
+                                init_level(w->states + i, victim->states + 0);
+                                copy_state(w->states + i, victim->states + i);
+                        }
+                        state_s *root = w->states + l;
+                        root->character_queue[0] = c;
+                        root->character_queue_size = 1;
+                        root->character_representative[c] = c;
+                        memcpy(w->path, victim->path, (l + 1) * sizeof(uint64_t));
+                        memset(w->stolen, 0, (sp->max_depth + 1) * sizeof(bool));
+#pragma omp atomic
+                        sp->active++;
+                        omp_set_lock(&w->lock);
+                        w->root = l;
+                        w->level = l;
+                        w->seen_cuts = victim->seen_cuts;
+                        w->active = true;
+                        omp_unset_lock(&w->lock);
+                        return true;
                 }
-                log_debug("next_node: end. LEVEL. Move to level: %d", level + 1);
-                return (level + 1);
         }
-/***********************************************/
-/* The next solution is not feasible        */
-/***********************************************/
-        log_debug("next_node: end. LEVEL. Stay at level: %d", level);
-        return (level);
+        return false;
 }
 
-bool
-exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth) {
-        log_debug("exhaustive_search: init");
+static bool
+steal(search_s *sp, uint32_t id) {
+        for (uint32_t i = 1; i < sp->num_workers; i++) {
+                uint32_t v = (id + i) % sp->num_workers;
+                search_worker_s *victim = sp->workers + v;
+                if (!omp_test_lock(&victim->lock))
+                        continue;
+                bool stolen = victim->active && steal_character(sp, id, v);
+                omp_unset_lock(&victim->lock);
+                if (stolen)
+                        return true;
+        }
+        return false;
+}
+
+/**
+   \brief updates the worker \c id after that \c next_node has moved it from
+   \c level to \c next. It requires the lock of the worker. The levels above
+   \c level have been created by \c next_node, and are new nodes.
+
+   Backtracking from the root is the normal end of the task, since the other
+   characters of the root level belong to the victim. Any other backtrack that
+   skips some levels is published, if those levels have been stolen from or if
+   they belong to other workers.
+*/
+static void
+advance(search_s *sp, uint32_t id, uint32_t level, uint32_t next) {
+        search_worker_s *w = sp->workers + id;
+        if (next != -1 && next > level) {
+                w->level = next;
+                for (uint32_t l = level + 1; l <= next; l++) {
+                        w->path[l] = new_node_id(sp);
+                        w->stolen[l] = false;
+                }
+                if ((w->states + next)->num_species == 0) {
+#pragma omp critical (search_winner)
+                        if (!sp->done) {
+                                sp->winner = id;
+#pragma omp atomic write
+                                sp->done = true;
+                        }
+                }
+                return;
+        }
+        if (next == level)
+                return;
+        bool above_root = (next == -1 || next < w->root);
+        if (level > w->root) {
+                bool publish = above_root;
+                for (uint32_t l = next + 1; !publish && l < level; l++)
+                        publish = w->stolen[l];
+                if (publish)
+                        publish_cut(sp, id, level, next);
+        }
+        if (above_root)
+                finish_task(sp, w);
+        else
+                w->level = next;
+}
+
+static void
+search_worker(search_s *sp, uint32_t id, const state_s *initial) {
+        search_worker_s *w = sp->workers + id;
+        if (w->states == NULL)
+                w->states = xmalloc((sp->max_depth + 1) * sizeof(state_s));
+        search_context_s context = { .strategy = sp->strategy, .start = sp->start };
+        add_phase_times(&context.stats, -1);
+        while (!search_done(sp)) {
+                if (!w->active) {
+                        uint32_t active;
+#pragma omp atomic read
+                        active = sp->active;
+                        if (active == 0)
+                                break;
+                        if (!steal(sp, id))
+                                sched_yield();
+                        continue;
+                }
+                if (!apply_cuts(sp, id))
+                        continue;
+                uint32_t level = w->level;
+                uint64_t nodes = context.stats.nodes;
+                uint64_t backtracks = context.stats.backtracks;
+                uint32_t next = traced_next_node(w->states, level, &context);
+                omp_set_lock(&w->lock);
+                advance(sp, id, level, next);
+                omp_unset_lock(&w->lock);
+#pragma omp atomic capture
+                nodes = sp->nodes += context.stats.nodes - nodes;
+#pragma omp atomic capture
+                backtracks = sp->backtracks += context.stats.backtracks - backtracks;
+                if (budget_exhausted(nodes, backtracks, sp->start, context.stats.steps)) {
+#pragma omp critical (search_winner)
+                        if (!sp->done) {
+                                sp->unknown = true;
+#pragma omp atomic write
+                                sp->done = true;
+                        }
+                }
+        }
+        add_phase_times(&context.stats, 1);
+#pragma omp critical (search_stats)
+        merge_stats(&sp->stats, &context.stats);
+}
+
+uint32_t
+parallel_exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth, uint32_t num_threads, search_stats_s *stats) {
+        log_debug("parallel_exhaustive_search: init");
+        double start = monotonic_seconds();
+        search_context_s context = { .strategy = strategy };
+        add_phase_times(&context.stats, -1);
         cleanup(states + 0);
         update_connected_components(states + 0);
-        log_debug("exhaustive_search: end init");
-        init_node(states + 0, strategy);
+        init_node(states + 0, &context);
         (states + 0)->backtrack_level = -1;
-        for(uint32_t level = 0; level != -1; level = next_node(states, level, strategy)) {
-                log_debug("exhaustive_search: level %d", level);
-                log_decisions(states, level);
-                log_state(states + level);
-                assert(level <= max_depth);
-                if ((states + level)->num_species == 0) {
-                        log_debug("exhaustive_search: solution found");
-                        return true;
+        add_phase_times(&context.stats, 1);
+        if ((states + 0)->num_species == 0) {
+                context.stats.outcome = SEARCH_FOUND;
+                context.stats.seconds = monotonic_seconds() - start;
+                if (stats != NULL)
+                        *stats = context.stats;
+                return SEARCH_FOUND;
+        }
+
+        search_s search = {
+                .workers = xmalloc(num_threads * sizeof(search_worker_s)),
+                .num_workers = num_threads,
+                .max_depth = max_depth,
+                .strategy = strategy,
+                .active = 1,
+                .next_id = 1,
+                .done = false,
+                .unknown = false,
+                .winner = 0,
+                .nodes = context.stats.nodes,
+                .backtracks = 0,
+                .start = start,
+                .stats = context.stats,
+                .cuts = NULL,
+                .num_cuts = 0,
+                .cuts_capacity = 0
+        };
+        omp_init_lock(&search.cuts_lock);
+        for (uint32_t i = 0; i < num_threads; i++) {
+                search_worker_s *w = search.workers + i;
+                *w = (search_worker_s) {
+                        .states = (i == 0) ? states : NULL,
+                        .path = xmalloc((max_depth + 1) * sizeof(uint64_t)),
+                        .stolen = xmalloc((max_depth + 1) * sizeof(bool)),
+                        .root = 0,
+                        .level = 0,
+                        .seen_cuts = 0,
+                        .active = (i == 0),
+                        .arena = NULL
+                };
+                memset(w->stolen, 0, (max_depth + 1) * sizeof(bool));
+                w->path[0] = 0;
+                omp_init_lock(&w->lock);
+        }
+/*
+  The first worker is the calling thread, which allocates from the arena of
+  the caller, while the other workers have their own arena, which lasts until
+  the solution has been copied back.
+*/
+#pragma omp parallel num_threads(num_threads)
+        {
+                bool registered = gc_register_thread();
+                uint32_t id = omp_get_thread_num();
+                search_worker_s *w = search.workers + id;
+                arena_s *previous = NULL;
+                if (id > 0) {
+                        w->arena = arena_new();
+                        previous = arena_use(w->arena);
                 }
+                search_worker(&search, id, states);
+                if (id > 0)
+                        arena_use(previous);
+                gc_unregister_thread(registered);
         }
-        log_debug("exhaustive_search: solution not found");
-        return false;
+        for (uint32_t i = 0; i < num_threads; i++)
+                omp_destroy_lock(&search.workers[i].lock);
+        omp_destroy_lock(&search.cuts_lock);
+        search.stats.outcome = !search.done ? SEARCH_NOT_FOUND : search.unknown ? SEARCH_UNKNOWN : SEARCH_FOUND;
+        search.stats.seconds = monotonic_seconds() - start;
+        if (trace_enabled())
+                trace_event(TRACE_SEARCH, start, search.stats.seconds, search.stats.outcome, search.stats.nodes, 0, 0);
+        if (stats != NULL)
+                *stats = search.stats;
+        if (!search.done) {
+                log_debug("parallel_exhaustive_search: solution not found");
+        } else if (search.unknown) {
+                log_debug("parallel_exhaustive_search: budget exhausted");
+        } else {
+/* The caller expects the solution in states */
+                search_worker_s *winner = search.workers + search.winner;
+                if (search.winner != 0)
+                        for (uint32_t l = 0; l <= winner->level; l++) {
+                                init_level(states + l, states + 0);
+                                copy_state(states + l, winner->states + l);
+                        }
+                log_debug("parallel_exhaustive_search: solution found by worker %d", search.winner);
+        }
+        for (uint32_t i = 1; i < num_threads; i++)
+                arena_delete(search.workers[i].arena);
+        return search.stats.outcome;
 }
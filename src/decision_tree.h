@@ -19,16 +19,64 @@
 
 */
 #include "perfect_phylogeny.h"
+#include "strategy.h"
+
+#define SEARCH_NOT_FOUND        0
+#define SEARCH_FOUND            1
+#define SEARCH_UNKNOWN          2
 
 /**
-   The strategy is a function that take as a parameter a pointer to a new
-   state, analyzes such state to which characters can be realized and
-   their order.
+   \struct search_stats_s
+   \brief the outcome of a search and the work done.
 
-   In other words, it computes in which order we try to realize the characters
-   at the current node of the decision tree
+   \c nodes is the number of nodes of the decision tree created, \c steps
+   the number of calls of \c next_node, \c backtracks the number of times
+   that the search has moved to a lower level, and \c completed_components
+   the number of connected components of the red-black graph that have been
+   completely solved. The realizations of inactive (black) and of active
+   (red) characters are counted separately, according to their success.
+   \c forced_moves is the number of realizations that have been propagated
+   without a choice (see \c next_node), and \c red_sigma_graphs the number
+   of successful realizations whose subtree has been pruned, since they
+   have created a red Σ-graph. \c backjumps is the number of backtracks
+   that have skipped some nodes with characters left to try, since their
+   decisions are not involved in the failure.
+   \c tt_lookups and \c tt_hits are the lookups of the transposition table
+   and those that have found the state, and they are 0 when there is no
+   table.
+   \c perfect_phylogeny_nodes is the number of nodes, of the decision tree or
+   of the greedy reduction, whose current component has a perfect phylogeny
+   (see \c perfect_phylogeny_root), and \c perfect_phylogeny is \c true iff the whole
+   instance has been solved by \c perfect_phylogeny_newick, without search.
+   \c reduction is \c true iff the greedy reduction (see reduction.h) has
+   found a solution.
+   \c max_depth is the deepest level reached, \c seconds the elapsed time
+   and \c phase_seconds the time spent in each phase of \c set_phase_timing,
+   which is 0 unless the timing is enabled. In \c parallel_exhaustive_search
+   the counters and the times of the phases are summed over all threads.
 */
-typedef uint32_t (*strategy_fn)(state_s *stp, uint32_t *chars);
+typedef struct search_stats_s {
+        uint32_t outcome;
+        uint64_t nodes;
+        uint64_t steps;
+        uint64_t backtracks;
+        uint64_t completed_components;
+        uint64_t realized_black;
+        uint64_t failed_black;
+        uint64_t realized_red;
+        uint64_t failed_red;
+        uint64_t forced_moves;
+        uint64_t red_sigma_graphs;
+        uint64_t backjumps;
+        uint64_t tt_lookups;
+        uint64_t tt_hits;
+        uint64_t perfect_phylogeny_nodes;
+        bool perfect_phylogeny;
+        bool reduction;
+        uint32_t max_depth;
+        double seconds;
+        double phase_seconds[NUM_PHASES];
+} search_stats_s;
 
 /**
    \brief visits the entire tree of the possible completions
@@ -38,9 +86,85 @@ typedef uint32_t (*strategy_fn)(state_s *stp, uint32_t *chars);
    \param strategy: the callback function that determines the order according to
    which all characters are tried
    \param max_depth: maximum depth of the search tree
+   \param stats: if not \c NULL, where the work done is stored
+
+   returns \c SEARCH_FOUND if a solution is found, \c SEARCH_NOT_FOUND if
+   there is no solution, and \c SEARCH_UNKNOWN if the budget set by
+   \c set_search_limits has been exhausted before the end of the search
+
+   When a node has no solution, the search goes back directly to the
+   deepest decision that has realized a character involved in the failure,
+   skipping the other decisions.
+   The backjumps are not used by \c parallel_exhaustive_search, since a
+   thread can exhaust a node while some of its children are visited by
+   other threads.
+*/
+
+uint32_t
+exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth, search_stats_s *stats);
+
+/**
+   \brief sets the budget of each search started afterwards: the maximum
+   number of seconds, of nodes of the decision tree and of backtracks. A
+   limit equal to 0 (the default) is not checked.
+
+   The budget is shared by all threads of \c parallel_exhaustive_search.
+   The limits are soft: the sequential search checks them after each node,
+   also while it propagates forced moves, but each thread of the parallel
+   search checks the shared counters only after each call of \c next_node,
+   and the clock is read only periodically.
+*/
+void
+set_search_limits(double seconds, uint64_t nodes, uint64_t backtracks);
+
+/**
+   \brief sets the maximum size (in bytes) of the table of the states without
+   solution of each \c exhaustive_search started afterwards. The table is not
+   used if \c max_bytes is 0, which is the default.
 
-   returns \c true iff a solution is found
+   When the table is used, the hit rate is logged at the end of each search.
+   The table is not used by \c parallel_exhaustive_search, since a thread
+   can exhaust a node while some of its children are visited by other threads.
 */
+void
+set_transposition_table_size(size_t max_bytes);
 
-bool
-exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth);
+#define RESTART_NONE            0
+#define RESTART_LUBY            1
+#define RESTART_GEOMETRIC       2
+
+/**
+   \brief sets the restart schedule of each \c exhaustive_search started
+   afterwards.
+
+   With \c RESTART_NONE (the default) the decision tree is visited once.
+   Otherwise the characters with the same priority according to the strategy
+   are tried in random order, with a generator initialized with \c seed,
+   and the search starts again from the root when a run has created too many
+   nodes: \c base_nodes times the terms of the Luby sequence (1, 1, 2, 1, 1,
+   2, 4, ...) with \c RESTART_LUBY, and \c base_nodes increased by half at
+   each run with \c RESTART_GEOMETRIC. After \c max_restarts restarts, the
+   last run is not limited, so that the search remains complete.
+
+   The restarts are not used by \c parallel_exhaustive_search.
+*/
+void
+set_restarts(uint32_t schedule, uint32_t base_nodes, uint32_t max_restarts, uint64_t seed);
+
+/**
+   \brief visits the tree of the possible completions with \c num_threads
+   threads, and stops as soon as one of them finds a solution.
+
+   Each thread has its own array of states. The characters that are left in
+   the queue of a level of a thread are independent subtrees, and an idle
+   thread steals one of them from the shallowest level of another thread,
+   copying the levels above it. The backtracks that skip some levels are
+   shared among all threads, so that the subtrees that the sequential search
+   would not visit are abandoned.
+
+   Parameters and result are as in \c exhaustive_search, and the states of
+   the solution are stored in \c states, which must not share their graphs.
+   The solution found can differ from the one of \c exhaustive_search.
+*/
+uint32_t
+parallel_exhaustive_search(state_s *states, strategy_fn strategy, uint32_t max_depth, uint32_t num_threads, search_stats_s *stats);
@@ -31,11 +31,24 @@ graph_check(const graph_s *gp) {
         assert(gp != NULL);
         unsigned int err = 0;
 #ifdef DEBUG
+        uint32_t n = gp->num_vertices;
+        if (gp->representation != GRAPH_DENSE) {
+                if (gp->rows == NULL)
+                        err = 7;
+                if (err == 0)
+                        for (uint32_t v=0; v < n; v++) {
+                                if (graph_get_edge(gp, v, v))
+                                        err = 8;
+                                for (uint32_t v2 = v + 1; v2 < n; v2++)
+                                        if (graph_get_edge(gp, v, v2) != graph_get_edge(gp, v2, v))
+                                                err = 9;
+                        }
+                goto check_done;
+        }
         if (gp->degrees == NULL)
                 err = 1;
         if (gp->adjacency == NULL)
                 err = 2;
-        uint32_t n = gp->num_vertices;
 
         for (uint32_t v=0; v < n; v++)
                 if (gp->degrees[v] > n)
@@ -70,7 +83,7 @@ graph_check(const graph_s *gp) {
                                         err = 6;
                 }
 
-
+check_done:
 #endif
         if (err > 0) {
                 graph_pp(gp);
@@ -82,25 +95,184 @@ graph_check(const graph_s *gp) {
 
 graph_s*
 graph_new(uint32_t n) {
-        log_debug("graph_new (n=%d)", n);
+        return graph_new_representation(n, GRAPH_DENSE);
+}
+
+graph_s*
+graph_new_representation(uint32_t n, uint32_t representation) {
+        log_debug("graph_new (n=%d, representation=%d)", n, representation);
         graph_s* gp = xmalloc(sizeof(graph_s));
-        gp->num_vertices = n;
-        gp->adjacency = xmalloc(n * n * sizeof(bool));
-        memset(gp->adjacency, 0, n * n * sizeof(bool));
-        gp->degrees = xmalloc(n * sizeof(uint32_t));
-        memset(gp->degrees, 0, n * sizeof(uint32_t));
-        gp->adjacency_lists = xmalloc(n * n * sizeof(uint32_t));
-        memset(gp->adjacency_lists, 0, n * n * sizeof(uint32_t));
+        graph_init_representation(gp, n, representation, xmalloc(graph_data_size(n, representation)));
+        return gp;
+}
 
+graph_s*
+graph_new_bipartite(uint32_t num_left, uint32_t num_right) {
+        log_debug("graph_new_bipartite (left=%d, right=%d)", num_left, num_right);
+        graph_s* gp = xmalloc(sizeof(graph_s));
+        graph_init_bipartite(gp, num_left, num_right, xmalloc(graph_bipartite_data_size(num_left, num_right)));
         return gp;
 }
 
+/*
+  A dense graph stores its degrees, its adjacency lists and its adjacency
+  matrix, in this order, so that each array is aligned.
+*/
+size_t
+graph_data_size(uint32_t n, uint32_t representation) {
+        if (representation == GRAPH_BITMAP)
+                return (size_t) n * BITMAP_NWORDS(n) * sizeof(bitmap_word);
+        assert(representation == GRAPH_DENSE);
+        if ((size_t) n * n > (SIZE_MAX - (size_t) n * sizeof(uint32_t)) / (sizeof(uint32_t) + sizeof(bool)))
+                return SIZE_MAX;
+        return (size_t) n * sizeof(uint32_t) + (size_t) n * n * (sizeof(uint32_t) + sizeof(bool));
+}
+
+size_t
+graph_bipartite_data_size(uint32_t num_left, uint32_t num_right) {
+        return ((size_t) num_left * BITMAP_NWORDS(num_right) + (size_t) num_right * BITMAP_NWORDS(num_left)) * sizeof(bitmap_word);
+}
+
+void
+graph_init_representation(graph_s* gp, uint32_t n, uint32_t representation, void* data) {
+        gp->trail = NULL;
+        gp->num_vertices = n;
+        gp->representation = representation;
+        gp->num_left = 0;
+        gp->right_row_words = 0;
+        memset(data, 0, graph_data_size(n, representation));
+        if (representation == GRAPH_BITMAP) {
+                gp->row_words = BITMAP_NWORDS(n);
+                gp->num_words = (size_t) n * gp->row_words;
+                gp->rows = data;
+                gp->adjacency = NULL;
+                gp->degrees = NULL;
+                gp->adjacency_lists = NULL;
+                return;
+        }
+        assert(representation == GRAPH_DENSE);
+        gp->rows = NULL;
+        gp->num_words = 0;
+        gp->row_words = 0;
+        gp->degrees = data;
+        gp->adjacency_lists = gp->degrees + n;
+        gp->adjacency = (bool*) (gp->adjacency_lists + (size_t) n * n);
+}
+
+void
+graph_init_bipartite(graph_s* gp, uint32_t num_left, uint32_t num_right, void* data) {
+        gp->trail = NULL;
+        gp->num_vertices = num_left + num_right;
+        gp->num_left = num_left;
+        gp->representation = GRAPH_BIPARTITE;
+        gp->row_words = BITMAP_NWORDS(num_right);
+        gp->right_row_words = BITMAP_NWORDS(num_left);
+        gp->num_words = (size_t) num_left * gp->row_words + (size_t) num_right * gp->right_row_words;
+        gp->rows = data;
+        memset(gp->rows, 0, gp->num_words * sizeof(bitmap_word));
+        gp->adjacency = NULL;
+        gp->degrees = NULL;
+        gp->adjacency_lists = NULL;
+}
+
+/**
+   \brief the row of the bit-packed adjacency matrix of vertex \c v.
+
+   The bit \c i of the row encodes the edge between \c v and the
+   vertex \c graph_row_first(gp, v) + i, and the row has \c
+   graph_row_bits(gp, v) bits.
+*/
+static inline bitmap_word*
+graph_row(const graph_s* gp, uint32_t v) {
+        if (gp->representation == GRAPH_BIPARTITE && v >= gp->num_left)
+                return gp->rows + (size_t) gp->num_left * gp->row_words + (size_t) (v - gp->num_left) * gp->right_row_words;
+        return gp->rows + (size_t) v * gp->row_words;
+}
+
+static inline uint32_t
+graph_row_first(const graph_s* gp, uint32_t v) {
+        return (gp->representation == GRAPH_BIPARTITE && v < gp->num_left) ? gp->num_left : 0;
+}
+
+static inline uint32_t
+graph_row_bits(const graph_s* gp, uint32_t v) {
+        if (gp->representation == GRAPH_BIPARTITE)
+                return (v < gp->num_left) ? gp->num_vertices - gp->num_left : gp->num_left;
+        return gp->num_vertices;
+}
+
+/**
+   \brief true if \c v1 and \c v2 can be adjacent, that is if they are not on
+   the same side of a bipartite graph
+*/
+static inline bool
+graph_admissible_edge(const graph_s* gp, uint32_t v1, uint32_t v2) {
+        return (gp->representation != GRAPH_BIPARTITE || (v1 < gp->num_left) != (v2 < gp->num_left));
+}
+
+
+graph_trail_s*
+graph_trail_new(void) {
+        graph_trail_s* trail = xmalloc(sizeof(graph_trail_s));
+        trail->size = 0;
+        trail->capacity = 64;
+        trail->changes = xmalloc(trail->capacity * sizeof(graph_change_s));
+        return trail;
+}
+
+void
+graph_set_trail(graph_s* gp, graph_trail_s* trail) {
+        gp->trail = trail;
+}
+
+/**
+   \brief records in the trail of \c gp that the edge \c (v1,v2) is
+   being added or removed.
+
+   Only actual changes are recorded, otherwise undoing the change would
+   alter the graph.
+*/
+static void
+graph_trail_push(graph_s* gp, uint32_t v1, uint32_t v2, bool added) {
+        graph_trail_s* trail = gp->trail;
+        if (graph_get_edge(gp, v1, v2) == added)
+                return;
+        if (trail->size == trail->capacity) {
+                trail->capacity *= 2;
+                trail->changes = xrealloc(trail->changes, trail->capacity * sizeof(graph_change_s));
+        }
+        trail->changes[trail->size++] = (graph_change_s) { .graph = gp, .v1 = v1, .v2 = v2, .added = added };
+}
 
+void
+graph_trail_undo(graph_trail_s* trail, size_t mark) {
+        assert(mark <= trail->size);
+        log_debug("graph_trail_undo: from %zu to %zu", trail->size, mark);
+        while (trail->size > mark) {
+                graph_change_s* change = trail->changes + (--trail->size);
+                graph_s* gp = change->graph;
+                gp->trail = NULL;
+                if (change->added)
+                        graph_del_edge(gp, change->v1, change->v2);
+                else
+                        graph_add_edge(gp, change->v1, change->v2);
+                gp->trail = trail;
+        }
+}
 
 void
 graph_add_edge(graph_s* gp, uint32_t v1, uint32_t v2) {
         log_debug("graph_add_edge %d %d", v1, v2);
         graph_check(gp);
+        if (gp->trail != NULL)
+                graph_trail_push(gp, v1, v2, true);
+        if (gp->representation != GRAPH_DENSE) {
+                assert(graph_admissible_edge(gp, v1, v2));
+                bitmap_set_bit(graph_row(gp, v1), v2 - graph_row_first(gp, v1));
+                bitmap_set_bit(graph_row(gp, v2), v1 - graph_row_first(gp, v2));
+                graph_check(gp);
+                return;
+        }
         gp->adjacency[v1 * (gp->num_vertices) + v2] = true;
         gp->adjacency[v2 * (gp->num_vertices) + v1] = true;
         (gp->adjacency_lists)[v1 * (gp->num_vertices) + graph_degree(gp, v1)] = v2;
@@ -114,22 +286,58 @@ graph_add_edge(graph_s* gp, uint32_t v1, uint32_t v2) {
 
 bool
 graph_get_edge(const graph_s* gp, uint32_t v1, uint32_t v2) {
+        if (gp->representation != GRAPH_DENSE)
+                return graph_admissible_edge(gp, v1, v2) && bitmap_get_bit(graph_row(gp, v1), v2 - graph_row_first(gp, v1));
         return (gp->adjacency[v1 * (gp->num_vertices) + v2]);
 }
 
 /**
    \brief returns the (pos+1)-th vertex that is adjacent to v1
+
+   With the \c GRAPH_BITMAP and \c GRAPH_BIPARTITE representations the neighbors are sorted and
+   finding the (pos+1)-th requires a scan of the row: use \c
+   graph_next_neighbor to visit all neighbors.
 */
 uint32_t
 graph_get_edge_pos(const graph_s* gp, uint32_t v, uint32_t pos) {
         assert(pos < graph_degree(gp, v));
+        if (gp->representation != GRAPH_DENSE) {
+                uint32_t w = graph_next_neighbor(gp, v, 0);
+                for (; pos > 0; pos--)
+                        w = graph_next_neighbor(gp, v, w + 1);
+                return w;
+        }
         return (gp->adjacency_lists)[v * (gp->num_vertices) + pos];
 }
 
+uint32_t
+graph_next_neighbor(const graph_s* gp, uint32_t v, uint32_t w) {
+        assert(v < gp->num_vertices);
+        if (gp->representation != GRAPH_DENSE) {
+                uint32_t first = graph_row_first(gp, v);
+                uint32_t bits = graph_row_bits(gp, v);
+                uint32_t next = bitmap_next_set(graph_row(gp, v), bits, (w > first) ? w - first : 0);
+                return (next < bits) ? first + next : gp->num_vertices;
+        }
+        for (; w < gp->num_vertices; w++)
+                if (gp->adjacency[v * (gp->num_vertices) + w])
+                        return w;
+        return gp->num_vertices;
+}
+
 void
 graph_del_edge(graph_s* gp, uint32_t v1, uint32_t v2) {
         log_debug("graph_del_edge %d %d", v1, v2);
         graph_check(gp);
+        if (gp->trail != NULL)
+                graph_trail_push(gp, v1, v2, false);
+        if (gp->representation != GRAPH_DENSE) {
+                assert(graph_admissible_edge(gp, v1, v2));
+                bitmap_clear_bit(graph_row(gp, v1), v2 - graph_row_first(gp, v1));
+                bitmap_clear_bit(graph_row(gp, v2), v1 - graph_row_first(gp, v2));
+                graph_check(gp);
+                return;
+        }
         gp->adjacency[v1 * (gp->num_vertices) + v2] = false;
         gp->adjacency[v2 * (gp->num_vertices) + v1] = false;
 
@@ -153,10 +361,33 @@ graph_del_edge(graph_s* gp, uint32_t v1, uint32_t v2) {
         graph_check(gp);
 }
 
+void
+graph_isolate_vertex(graph_s* gp, uint32_t v) {
+        log_debug("graph_isolate_vertex %d", v);
+        if (gp->representation == GRAPH_DENSE) {
+                while (gp->degrees[v] > 0)
+                        graph_del_edge(gp, v, gp->adjacency_lists[v * (gp->num_vertices) + gp->degrees[v] - 1]);
+                return;
+        }
+        for (uint32_t w = graph_next_neighbor(gp, v, 0); w < gp->num_vertices; w = graph_next_neighbor(gp, v, w + 1))
+                graph_del_edge(gp, v, w);
+}
+
 void
 graph_nuke_edges(graph_s* gp) {
         log_debug("graph_nuke_edges");
         graph_check(gp);
+        if (gp->trail != NULL) {
+                /* each removed edge must be recorded in the trail */
+                for (uint32_t v = 0; v < gp->num_vertices; v++)
+                        for (uint32_t w = graph_next_neighbor(gp, v, 0); w < gp->num_vertices; w = graph_next_neighbor(gp, v, w + 1))
+                                graph_del_edge(gp, v, w);
+                return;
+        }
+        if (gp->representation != GRAPH_DENSE) {
+                memset(gp->rows, 0, gp->num_words * sizeof(bitmap_word));
+                return;
+        }
         memset(gp->degrees, 0, (gp->num_vertices) * sizeof((gp->degrees)[0]));
         memset(gp->adjacency, 0, (gp->num_vertices) * (gp->num_vertices) * sizeof((gp->adjacency)[0]));
         memset(gp->adjacency_lists, 0, (gp->num_vertices) * (gp->num_vertices) * sizeof((gp->adjacency_lists)[0]));
@@ -164,6 +395,123 @@ graph_nuke_edges(graph_s* gp) {
 }
 
 
+/**
+   \brief appends to \c queue (currently with \c size elements) all
+   vertices adjacent to \c v that are not \c reached, marking them as
+   reached.
+
+   \return the new size of the queue
+*/
+static uint32_t
+graph_push_unreached(const graph_s* gp, uint32_t v, bool* reached, uint32_t* queue, uint32_t size) {
+        if (gp->representation != GRAPH_DENSE) {
+                const bitmap_word* row = graph_row(gp, v);
+                uint32_t first = graph_row_first(gp, v);
+                for (uint32_t i = 0; i < BITMAP_NWORDS(graph_row_bits(gp, v)); i++)
+                        for (bitmap_word word = row[i]; word != 0; word &= word - 1) {
+                                uint32_t w = first + i * BITMAP_WORD_BITS + __builtin_ctzl(word);
+                                if (!reached[w]) {
+                                        queue[size++] = w;
+                                        reached[w] = true;
+                                }
+                        }
+                return size;
+        }
+        for (uint32_t p = 0; p < graph_degree(gp, v); p++) {
+                uint32_t w = graph_get_edge_pos(gp, v, p);
+                if (!reached[w]) {
+                        queue[size++] = w;
+                        reached[w] = true;
+                }
+        }
+        return size;
+}
+
+/**
+   \brief the bitmaps of vertices used by the bit-parallel visits have a
+   segment for each side of the graph: the vertices smaller than \c
+   graph_split(gp) and the remaining vertices. Except for \c GRAPH_BIPARTITE
+   graphs, the second segment is empty.
+
+   This way the row of each vertex can be OR-ed into a segment without any
+   shift.
+*/
+static inline uint32_t
+graph_split(const graph_s* gp) {
+        return (gp->representation == GRAPH_BIPARTITE) ? gp->num_left : gp->num_vertices;
+}
+
+static inline uint32_t
+graph_vertex_words(const graph_s* gp) {
+        return BITMAP_NWORDS(graph_split(gp)) + BITMAP_NWORDS(gp->num_vertices - graph_split(gp));
+}
+
+static inline void
+vertex_bitmap_set(const graph_s* gp, bitmap_word* bm, uint32_t v) {
+        uint32_t split = graph_split(gp);
+        if (v < split)
+                bitmap_set_bit(bm, v);
+        else
+                bitmap_set_bit(bm + BITMAP_NWORDS(split), v - split);
+}
+
+static inline bool
+vertex_bitmap_get(const graph_s* gp, bitmap_word* bm, uint32_t v) {
+        uint32_t split = graph_split(gp);
+        if (v < split)
+                return bitmap_get_bit(bm, v);
+        return bitmap_get_bit(bm + BITMAP_NWORDS(split), v - split);
+}
+
+/**
+   \brief the smallest vertex at least \c v whose bit is \c set in \c bm,
+   or \c num_vertices if there is no such vertex
+*/
+static inline uint32_t
+vertex_bitmap_next(const graph_s* gp, const bitmap_word* bm, uint32_t v, bool set) {
+        uint32_t split = graph_split(gp);
+        if (v < split) {
+                uint32_t w = set ? bitmap_next_set(bm, split, v) : bitmap_next_zero(bm, split, v);
+                if (w < split)
+                        return w;
+                v = split;
+        }
+        bm += BITMAP_NWORDS(split);
+        return split + (set ? bitmap_next_set(bm, gp->num_vertices - split, v - split) :
+                        bitmap_next_zero(bm, gp->num_vertices - split, v - split));
+}
+
+/**
+   \brief bit-parallel visit of a \c GRAPH_BITMAP or \c GRAPH_BIPARTITE graph
+   starting from \c v.
+
+   At each step the next frontier is the union of the rows of the vertices in
+   the current frontier, minus the vertices already reached.
+   \c reached, \c frontier and \c next are vertex bitmaps of \c
+   graph_vertex_words(gp) words, and at the end \c reached contains the
+   connected component of \c v.
+*/
+static void
+graph_reach_bitmap(const graph_s* gp, uint32_t v, bitmap_word* reached, bitmap_word* frontier, bitmap_word* next) {
+        uint32_t words = graph_vertex_words(gp);
+        uint32_t first_segment_words = BITMAP_NWORDS(graph_split(gp));
+        memset(reached, 0, words * sizeof(bitmap_word));
+        memset(frontier, 0, words * sizeof(bitmap_word));
+        vertex_bitmap_set(gp, reached, v);
+        vertex_bitmap_set(gp, frontier, v);
+        do {
+                memset(next, 0, words * sizeof(bitmap_word));
+                for (uint32_t u = vertex_bitmap_next(gp, frontier, 0, true); u < gp->num_vertices;
+                     u = vertex_bitmap_next(gp, frontier, u + 1, true)) {
+                        bitmap_word* target = next + ((graph_row_first(gp, u) == 0) ? 0 : first_segment_words);
+                        bitmap_or_words(target, graph_row(gp, u), BITMAP_NWORDS(graph_row_bits(gp, u)));
+                }
+                bitmap_word* tmp = frontier;
+                frontier = next;
+                next = tmp;
+        } while (bitmap_advance_frontier(frontier, reached, words));
+}
+
 void
 graph_reachable(const graph_s* gp, uint32_t v, bool* reached) {
         assert(gp != NULL);
@@ -171,6 +519,19 @@ graph_reachable(const graph_s* gp, uint32_t v, bool* reached) {
         graph_check(gp);
         log_debug("graph_reachable: graph_s=%p, v=%d, reached=%p", gp, v, reached);
         uint32_t n = gp->num_vertices;
+        if (gp->representation != GRAPH_DENSE) {
+                uint32_t words = graph_vertex_words(gp);
+                bitmap_word bits[words];
+                bitmap_word frontier[words];
+                bitmap_word next[words];
+                graph_reach_bitmap(gp, v, bits, frontier, next);
+                memset(reached, 0, n * sizeof(bool));
+                for (uint32_t w = vertex_bitmap_next(gp, bits, 0, true); w < n; w = vertex_bitmap_next(gp, bits, w + 1, true))
+                        reached[w] = true;
+                log_array_bool("reached: ", reached, gp->num_vertices);
+                log_debug("graph_reachable: end");
+                return;
+        }
         uint32_t border[n];
         uint32_t new_border[n];
         uint32_t border_size = 1;
@@ -179,16 +540,8 @@ graph_reachable(const graph_s* gp, uint32_t v, bool* reached) {
         reached[v] = true;
         while (border_size > 0) {
                 uint32_t new_border_size = 0;
-                for (uint32_t vx = 0; vx < border_size; vx++) {
-                        uint32_t v1 = border[vx];
-                        for (uint32_t p = 0; p < graph_degree(gp, v1); p++) {
-                                uint32_t w = graph_get_edge_pos(gp, v1, p);
-                                if (!reached[w]) {
-                                        new_border[new_border_size++] = w;
-                                        reached[w] = true;
-                                }
-                        }
-                }
+                for (uint32_t vx = 0; vx < border_size; vx++)
+                        new_border_size = graph_push_unreached(gp, border[vx], reached, new_border, new_border_size);
                 memcpy(border, new_border, new_border_size * sizeof(new_border[0]));
                 border_size = new_border_size;
         }
@@ -196,6 +549,88 @@ graph_reachable(const graph_s* gp, uint32_t v, bool* reached) {
         log_debug("graph_reachable: end");
 }
 
+uint32_t
+connected_components_split(const graph_s* gp, uint32_t* components, const bitmap_word* vertices, uint32_t next_label) {
+        assert(gp != NULL);
+        assert(components != NULL);
+        assert(vertices != NULL);
+        log_debug("connected_components_split: graph_s=%p next_label=%d", gp, next_label);
+        uint32_t n = gp->num_vertices;
+        bool first = true;
+        if (gp->representation != GRAPH_DENSE) {
+                uint32_t words = graph_vertex_words(gp);
+                bitmap_word done[words];
+                bitmap_word bits[words];
+                bitmap_word frontier[words];
+                bitmap_word next[words];
+                memset(done, 0, words * sizeof(bitmap_word));
+                for (uint32_t v = bitmap_next_set(vertices, n, 0); v < n; v = bitmap_next_set(vertices, n, v + 1)) {
+                        if (vertex_bitmap_get(gp, done, v))
+                                continue;
+                        uint32_t label = first ? components[v] : next_label++;
+                        first = false;
+                        graph_reach_bitmap(gp, v, bits, frontier, next);
+                        for (uint32_t w = vertex_bitmap_next(gp, bits, 0, true); w < n; w = vertex_bitmap_next(gp, bits, w + 1, true)) {
+                                assert(bitmap_get_bit(vertices, w));
+                                components[w] = label;
+                        }
+                        bitmap_or_words(done, bits, words);
+                }
+                log_array_uint32_t("component", components, n);
+                log_debug("connected_components_split: end");
+                return next_label;
+        }
+        bool reached[n];
+        memset(reached, 0, n * sizeof(bool));
+        uint32_t queue[n];
+        for (uint32_t v = bitmap_next_set(vertices, n, 0); v < n; v = bitmap_next_set(vertices, n, v + 1)) {
+                if (reached[v])
+                        continue;
+                uint32_t label = first ? components[v] : next_label++;
+                first = false;
+                queue[0] = v;
+                reached[v] = true;
+                for (uint32_t head = 0, size = 1; head < size; head++) {
+                        assert(bitmap_get_bit(vertices, queue[head]));
+                        components[queue[head]] = label;
+                        size = graph_push_unreached(gp, queue[head], reached, queue, size);
+                }
+        }
+        log_array_uint32_t("component", components, n);
+        log_debug("connected_components_split: end");
+        return next_label;
+}
+
+/**
+   \brief \c connected_components for the \c GRAPH_BITMAP and \c
+   GRAPH_BIPARTITE representations.
+
+   The visited vertices are kept in a bitmap, so that the next unexplored
+   vertex is found scanning a word at a time.
+*/
+static void
+connected_components_bitmap(const graph_s* gp, uint32_t* components) {
+        uint32_t n = gp->num_vertices;
+        uint32_t words = graph_vertex_words(gp);
+        bitmap_word visited[words];
+        bitmap_word bits[words];
+        bitmap_word frontier[words];
+        bitmap_word next[words];
+        memset(visited, 0, words * sizeof(bitmap_word));
+        uint32_t color = 0;
+        for (uint32_t v = 0; v < n; v = vertex_bitmap_next(gp, visited, v + 1, false), color++) {
+                if (graph_degree(gp, v) == 0) {
+                        components[v] = color;
+                        vertex_bitmap_set(gp, visited, v);
+                        continue;
+                }
+                graph_reach_bitmap(gp, v, bits, frontier, next);
+                for (uint32_t w = vertex_bitmap_next(gp, bits, v, true); w < n; w = vertex_bitmap_next(gp, bits, w + 1, true))
+                        components[w] = color;
+                bitmap_or_words(visited, bits, words);
+        }
+}
+
 void
 connected_components(graph_s* gp, uint32_t* components) {
         assert(gp!=NULL);
@@ -205,6 +640,12 @@ connected_components(graph_s* gp, uint32_t* components) {
         graph_check(gp);
         graph_pp(gp);
         memset(components, 0, (gp->num_vertices) * sizeof(uint32_t));
+        if (gp->representation != GRAPH_DENSE) {
+                connected_components_bitmap(gp, components);
+                log_array_uint32_t("component",components, gp->num_vertices);
+                log_debug("connected_components: end");
+                return;
+        }
         bool visited[gp->num_vertices];
         memset(visited, 0, gp->num_vertices * sizeof(bool));
 
@@ -260,6 +701,8 @@ graph_pp(const graph_s* gp) {
                 fprintf(stderr, "\n");
         }
 
+        if (gp->representation != GRAPH_DENSE)
+                return;
         fprintf(stderr, "Adjacency lists\n");
         for (uint32_t v=0; v < n; v++) {
                 fprintf(stderr, "Vertex %d (degree %d):", v, graph_degree(gp, v));
@@ -277,7 +720,15 @@ graph_copy(graph_s* dst, const graph_s* src) {
         log_debug("graph_copy");
         graph_check(src);
         graph_pp(src);
+        assert(dst->representation == src->representation);
         dst->num_vertices = src->num_vertices;
+        if (src->representation != GRAPH_DENSE) {
+                assert(dst->num_words == src->num_words);
+                memcpy(dst->rows, src->rows, src->num_words * sizeof(bitmap_word));
+                assert(graph_cmp(src, dst) == 0);
+                log_debug("graph_copy: end");
+                return;
+        }
         memcpy(dst->adjacency, src->adjacency, (src->num_vertices) * (src->num_vertices) * sizeof((src->adjacency)[0]));
         memcpy(dst->adjacency_lists, src->adjacency_lists, (src->num_vertices) * (src->num_vertices) * sizeof((src->adjacency_lists)[0]));
         memcpy(dst->degrees, src->degrees, (src->num_vertices) * sizeof((src->degrees)[0]));
@@ -295,6 +746,8 @@ graph_copy(graph_s* dst, const graph_s* src) {
 uint32_t
 graph_degree(const graph_s* gp, uint32_t v) {
         assert(v < gp->num_vertices);
+        if (gp->representation != GRAPH_DENSE)
+                return bitmap_popcount(graph_row(gp, v), graph_row_bits(gp, v));
         return (gp->degrees)[v];
 }
 
@@ -308,6 +761,15 @@ uint32_t graph_cmp(const graph_s *gp1, const graph_s *gp2) {
         if (gp1->num_vertices != gp2->num_vertices)
                 return 1;
 
+        if (gp1->representation != gp2->representation)
+                return 5;
+
+        if (gp1->num_left != gp2->num_left)
+                return 6;
+
+        if (gp1->representation != GRAPH_DENSE)
+                return memcmp(gp1->rows, gp2->rows, gp1->num_words * sizeof(bitmap_word)) ? 4 : 0;
+
         if (memcmp(gp1->degrees, gp2->degrees, (gp1->num_vertices) * sizeof((gp1->degrees)[0])))
                 return 2;
 
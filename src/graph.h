@@ -41,29 +41,106 @@
 #include <string.h>
 #include <err.h>
 #include <inttypes.h>
-#include <gc.h>
 #include <error.h>
 #include "logging.h"
 #include "memory.h"
+#include "bitmap.h"
 #include <omp.h>
+
+/**
+   \brief the possible representations of the adjacency of a graph
+
+   \c GRAPH_DENSE stores an adjacency matrix of \c bool, the adjacency lists and
+   the degree of each vertex.
+
+   \c GRAPH_BITMAP stores only a bit-packed adjacency matrix: each vertex has a
+   row of \c row_words words. The degree of a vertex is the popcount of its row
+   and the neighbors are visited by scanning the bits set in the row.
+
+   \c GRAPH_BIPARTITE stores a bipartite graph whose sides are the vertices
+   smaller than \c num_left and the remaining vertices. Only the biadjacency
+   matrix is stored: each vertex of the left side has a row of \c row_words
+   words over the right side, and each vertex of the right side has a row of
+   \c right_row_words words over the left side. Edges between two vertices
+   of the same side are not allowed.
+*/
+#define GRAPH_DENSE     0
+#define GRAPH_BITMAP    1
+#define GRAPH_BIPARTITE 2
+
 /**
    \struct graph_s
    \brief a graph is made of the adjacency list and the degree of each
    vertex, as well as the number of vertices
+
+   The fields \c degrees, \c adjacency and \c adjacency_lists are used only
+   by the \c GRAPH_DENSE representation, while \c rows (consisting of \c
+   num_words words) is used only by the \c GRAPH_BITMAP and \c
+   GRAPH_BIPARTITE representations.
+
+   If \c trail is not \c NULL, each edge that is added or removed is
+   recorded in the trail, so that the change can be undone.
 */
 
 typedef struct graph_s {
+        struct graph_trail_s *trail;
         uint32_t *degrees;
         bool *adjacency;
         uint32_t *adjacency_lists;
+        bitmap_word *rows;
+        size_t num_words;
+        uint32_t row_words;
+        uint32_t right_row_words;
+        uint32_t num_left;
         uint32_t num_vertices;
+        uint32_t representation;
 } graph_s;
 
+/**
+   \struct graph_change_s
+   \brief an edge that has been added to (or removed from) a graph
+*/
+typedef struct graph_change_s {
+        graph_s *graph;
+        uint32_t v1;
+        uint32_t v2;
+        bool added;
+} graph_change_s;
+
+/**
+   \struct graph_trail_s
+   \brief an undo log of the changes of some graphs.
+
+   Each graph whose \c trail field points to the trail appends its changes to
+   \c changes. The current \c size is a mark: undoing the trail up to a
+   mark restores all graphs as they were when the mark was taken.
+*/
+typedef struct graph_trail_s {
+        graph_change_s *changes;
+        size_t size;
+        size_t capacity;
+} graph_trail_s;
+
 /**
    \brief managing graphs:
    \c graph_new creates a new graph, allocating the necessary memory
    to store the desired number of vertices.
 
+   \c graph_new_representation creates a new graph with the given
+   representation (\c GRAPH_DENSE or \c GRAPH_BITMAP)
+
+   \c graph_new_bipartite creates a new \c GRAPH_BIPARTITE graph, whose
+   vertices are the \c num_left vertices of the left side followed by the
+   \c num_right vertices of the right side.
+
+   \c graph_init_representation and \c graph_init_bipartite are the same,
+   but they initialize \c gp and store the adjacency of the graph in \c
+   data, which must have \c graph_data_size (or \c
+   graph_bipartite_data_size) bytes, aligned as a \c bitmap_word, instead of
+   allocating them. The adjacency of the graph is all in \c data, so that
+   copying \c data is the same as \c graph_copy. \c graph_data_size is
+   \c SIZE_MAX if the size does not fit in a \c size_t.
+
    \c graph_add_edge adds an edge (returning false if the two vertices
    are already adjacent)
 
@@ -73,6 +150,24 @@ typedef struct graph_s {
 graph_s*
 graph_new(uint32_t num_vertices);
 
+graph_s*
+graph_new_representation(uint32_t num_vertices, uint32_t representation);
+
+graph_s*
+graph_new_bipartite(uint32_t num_left, uint32_t num_right);
+
+size_t
+graph_data_size(uint32_t num_vertices, uint32_t representation);
+
+size_t
+graph_bipartite_data_size(uint32_t num_left, uint32_t num_right);
+
+void
+graph_init_representation(graph_s* gp, uint32_t num_vertices, uint32_t representation, void* data);
+
+void
+graph_init_bipartite(graph_s* gp, uint32_t num_left, uint32_t num_right, void* data);
+
 void
 graph_add_edge(graph_s* gp, uint32_t v1, uint32_t v2);
 
@@ -85,6 +180,44 @@ graph_get_edge(const graph_s* gp, uint32_t v1, uint32_t v2);
 uint32_t
 graph_get_edge_pos(const graph_s* gp, uint32_t v1, uint32_t pos);
 
+/**
+   \brief returns the smallest vertex adjacent to \c v that is at least \c
+   w, or \c num_vertices if there is no such vertex.
+
+   It is the preferred way to visit all neighbors of a vertex, since
+   it does not depend on the representation of the graph:
+   \code
+   for (uint32_t w = graph_next_neighbor(gp, v, 0); w < gp->num_vertices; w = graph_next_neighbor(gp, v, w + 1))
+   \endcode
+*/
+uint32_t
+graph_next_neighbor(const graph_s* gp, uint32_t v, uint32_t w);
+
+/**
+   \brief managing undo trails:
+   \c graph_trail_new creates an empty trail.
+
+   \c graph_set_trail records all subsequent changes of the graph \c gp in
+   \c trail (or stops recording, if \c trail is \c NULL).
+
+   \c graph_trail_undo undoes, in reverse order, all changes recorded after
+   \c mark and removes them from the trail.
+*/
+graph_trail_s*
+graph_trail_new(void);
+
+void
+graph_set_trail(graph_s* gp, graph_trail_s* trail);
+
+void
+graph_trail_undo(graph_trail_s* trail, size_t mark);
+
+/**
+   \brief removes all edges incident on the vertex \c v
+*/
+void
+graph_isolate_vertex(graph_s* gp, uint32_t v);
+
 /**
    \brief removes all edges of a graph
 */
@@ -116,6 +249,21 @@ graph_degree(const graph_s* gp, uint32_t v);
 void
 connected_components(graph_s* gp, uint32_t* components);
 
+/**
+   \brief updates the connected components after some edges among the
+   vertices of the bitmap \c vertices have changed. \c vertices must be a single
+   connected component before the changes, since the only possible effect of
+   the changes is to split it.
+
+   The vertices of the first resulting component keep their previous label,
+   the other components receive the labels \c next_label, \c next_label + 1,
+   ...
+
+   \return the first label that has not been used
+*/
+uint32_t
+connected_components_split(const graph_s* gp, uint32_t* components, const bitmap_word* vertices, uint32_t next_label);
+
 /**
    \brief check if two graphs are the same.
    return a nonzero code if they differ
@@ -51,14 +51,10 @@ unsigned int log_error(const char* message, ...) {
         return ret;
 }
 unsigned int log_info(const char* message, ...) {
-#ifdef DEBUG
         va_list args; va_start(args, message);
         unsigned int ret = log_format("info", LOG_INFO, message, args);
         va_end(args);
         return ret;
-#else
-        return 0;
-#endif
 }
 unsigned int log_debug2(const char* message, ...) {
         va_list args; va_start(args, message);
@@ -1,8 +1,219 @@
 #include "memory.h"
+#include <stdint.h>
 
+#ifdef CPPP_ARENA
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+
+/**
+   \struct arena_chunk_s
+   \brief a block of memory of an arena. The chunks after the current one
+   are free, and they are reused before allocating a new chunk.
+*/
+typedef struct arena_chunk_s {
+        struct arena_chunk_s* next;
+        size_t size;
+        size_t used;
+        _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+} arena_chunk_s;
+
+struct arena_s {
+        arena_chunk_s* first;
+        arena_chunk_s* current;
+};
+
+/**
+   \struct block_header_s
+   \brief the header of each allocated block, so that \c xrealloc knows
+   its size and whether it belongs to an arena
+*/
+typedef struct block_header_s {
+        size_t size;
+        size_t in_arena;
+} block_header_s;
+
+static _Thread_local arena_s* current_arena = NULL;
+static _Thread_local arena_s* scratch = NULL;
+
+static void
+out_of_memory(void)
+{
+        fprintf(stderr, "insufficient memory\n");
+        assert(false);
+        exit(EXIT_FAILURE);
+}
+
+static arena_chunk_s*
+new_chunk(size_t n)
+{
+        size_t size = (n > ARENA_CHUNK_SIZE) ? n : ARENA_CHUNK_SIZE;
+        arena_chunk_s* chunk = malloc(sizeof(arena_chunk_s) + size);
+        if (chunk == NULL)
+                out_of_memory();
+        chunk->next = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        return chunk;
+}
+
+static void*
+arena_alloc(arena_s* arena, size_t n)
+{
+        arena_chunk_s* chunk = arena->current;
+        while (chunk->size - chunk->used < n) {
+                if (chunk->next == NULL || chunk->next->size < n) {
+                        arena_chunk_s* c = new_chunk(n);
+                        c->next = chunk->next;
+                        chunk->next = c;
+                }
+                chunk = chunk->next;
+                chunk->used = 0;
+        }
+        arena->current = chunk;
+        void* p = chunk->data + chunk->used;
+        chunk->used += n;
+        return p;
+}
+
+/**
+   \brief allocates \c n cleared bytes from the current arena, or with
+   \c malloc if the thread has no arena
+*/
+static void*
+allocate(size_t n)
+{
+        if (n > SIZE_MAX - sizeof(block_header_s) - ARENA_ALIGNMENT)
+                out_of_memory();
+        size_t size = (sizeof(block_header_s) + n + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+        block_header_s* header = (current_arena != NULL) ? arena_alloc(current_arena, size) : malloc(size);
+        if (header == NULL)
+                out_of_memory();
+        header->size = n;
+        header->in_arena = (current_arena != NULL);
+        return memset(header + 1, 0, n);
+}
+
+void *
+xmalloc(size_t n)
+{
+        return allocate(n);
+}
+
+void *
+xmalloc_atomic(size_t n)
+{
+        return allocate(n);
+}
+
+void *
+xcopy(void* src, size_t n)
+{
+        void *dst = xmalloc(n);
+        memcpy(dst, src, n);
+        return(dst);
+}
+
+/*
+  The block is always moved, since the arena where it has been allocated
+  can differ from the current one.
+*/
+void *
+xrealloc(void* p, size_t n)
+{
+        void* q = allocate(n);
+        if (p == NULL)
+                return q;
+        block_header_s* header = (block_header_s*) p - 1;
+        memcpy(q, p, (header->size < n) ? header->size : n);
+        if (!header->in_arena)
+                free(header);
+        return q;
+}
+
+bool
+gc_register_thread(void)
+{
+        return false;
+}
+
+void
+gc_unregister_thread(bool registered)
+{
+}
+
+arena_s*
+arena_new(void)
+{
+        arena_s* arena = malloc(sizeof(arena_s));
+        if (arena == NULL)
+                out_of_memory();
+        arena->first = new_chunk(ARENA_CHUNK_SIZE);
+        arena->current = arena->first;
+        return arena;
+}
+
+void
+arena_reset(arena_s* arena)
+{
+        arena->current = arena->first;
+        arena->current->used = 0;
+}
+
+void
+arena_delete(arena_s* arena)
+{
+        if (arena == NULL)
+                return;
+        for (arena_chunk_s* chunk = arena->first; chunk != NULL;) {
+                arena_chunk_s* next = chunk->next;
+                free(chunk);
+                chunk = next;
+        }
+        free(arena);
+}
+
+arena_s*
+arena_use(arena_s* arena)
+{
+        arena_s* previous = current_arena;
+        current_arena = arena;
+        return previous;
+}
+
+arena_s*
+scratch_arena(void)
+{
+        if (scratch == NULL)
+                scratch = arena_new();
+        return scratch;
+}
+
+void*
+xmalloc_scratch(size_t n)
+{
+        arena_s* arena = arena_use(scratch_arena());
+        void* p = allocate(n);
+        arena_use(arena);
+        return p;
+}
+
+arena_mark_s
+scratch_mark(void)
+{
+        arena_s* arena = scratch_arena();
+        return (arena_mark_s) { .chunk = arena->current, .used = arena->current->used };
+}
+
+void
+scratch_release(arena_mark_s mark)
+{
+        scratch->current = mark.chunk;
+        scratch->current->used = mark.used;
+}
+#else
 
 void *
-xmalloc(unsigned n)
+xmalloc(size_t n)
 {
         void *p;
         p = GC_MALLOC(n);
@@ -13,6 +224,18 @@ xmalloc(unsigned n)
         exit(EXIT_FAILURE);
 }
 
+void *
+xmalloc_atomic(size_t n)
+{
+        void *p;
+        p = GC_MALLOC_ATOMIC(n);
+        if (p != NULL)
+                return memset(p, 0, n);
+        fprintf(stderr, "insufficient memory\n");
+        assert(p != NULL);
+        exit(EXIT_FAILURE);
+}
+
 void *
 xcopy(void* src, size_t n)
 {
@@ -20,3 +243,77 @@ xcopy(void* src, size_t n)
         memcpy(dst, src, n);
         return(dst);
 }
+
+void *
+xrealloc(void* p, size_t n)
+{
+        p = GC_REALLOC(p, n);
+        if (p != NULL)
+                return p;
+        fprintf(stderr, "insufficient memory\n");
+        assert(p != NULL);
+        exit(EXIT_FAILURE);
+}
+
+bool
+gc_register_thread(void)
+{
+        if (GC_thread_is_registered())
+                return false;
+        struct GC_stack_base sb;
+        GC_get_stack_base(&sb);
+        return GC_register_my_thread(&sb) == GC_SUCCESS;
+}
+
+void
+gc_unregister_thread(bool registered)
+{
+        if (registered)
+                GC_unregister_my_thread();
+}
+
+arena_s*
+arena_new(void)
+{
+        return NULL;
+}
+
+void
+arena_reset(arena_s* arena)
+{
+}
+
+void
+arena_delete(arena_s* arena)
+{
+}
+
+arena_s*
+arena_use(arena_s* arena)
+{
+        return NULL;
+}
+
+arena_s*
+scratch_arena(void)
+{
+        return NULL;
+}
+
+void*
+xmalloc_scratch(size_t n)
+{
+        return xmalloc(n);
+}
+
+arena_mark_s
+scratch_mark(void)
+{
+        return (arena_mark_s) { .chunk = NULL, .used = 0 };
+}
+
+void
+scratch_release(arena_mark_s mark)
+{
+}
+#endif
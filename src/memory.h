@@ -1,9 +1,97 @@
+#ifndef CPPP_MEMORY_H
+#define CPPP_MEMORY_H
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
-#include <gc.h>
 #include <string.h>
+#include <stdbool.h>
 
+/*
+  All memory is allocated by the garbage collector, unless the program is
+  built with CPPP_ARENA (make arena): in that case the memory of the solver
+  is allocated from arenas, which are reset between instances, and the
+  garbage collector is not used.
+*/
+#ifdef CPPP_ARENA
+#define GC_INIT()
+#define GC_allow_register_threads()
+#else
+#include <gc.h>
+#endif
 
-void * xmalloc(unsigned n);
+void * xmalloc(size_t n);
+/**
+   \brief allocates \c n cleared bytes that do not contain any pointer, and
+   therefore are not scanned by the garbage collector
+*/
+void * xmalloc_atomic(size_t n);
 void * xcopy(void* src, size_t n);
+void * xrealloc(void* p, size_t n);
+
+/**
+   \brief registers the calling thread with the garbage collector, if it is
+   not already registered, so that it can allocate.
+
+   Returns \c true iff the thread has been registered by this call, and
+   therefore must be unregistered with \c gc_unregister_thread.
+   \c GC_allow_register_threads must have been called by the main thread.
+*/
+bool gc_register_thread(void);
+void gc_unregister_thread(bool registered);
+
+/**
+   \struct arena_s
+   \brief a region of memory where the allocations are consecutive, and that
+   is released all at once.
+
+   Each thread allocates from its current arena (set by \c arena_use), or
+   with \c malloc if it has none. An arena must be used by one thread at a
+   time. When the garbage collector is used, there are no arenas: the
+   functions below do nothing, \c arena_new and \c scratch_arena return
+   \c NULL, and \c xmalloc_scratch is \c xmalloc.
+*/
+typedef struct arena_s arena_s;
+
+/**
+   \struct arena_mark_s
+   \brief a position of the scratch arena, see \c scratch_mark
+*/
+typedef struct arena_mark_s {
+        void* chunk;
+        size_t used;
+} arena_mark_s;
+
+arena_s* arena_new(void);
+
+/**
+   \brief releases all memory allocated from \c arena, in constant time. The
+   memory is kept, and it is reused by the next allocations.
+*/
+void arena_reset(arena_s* arena);
+
+/**
+   \brief returns the memory of \c arena to the system
+*/
+void arena_delete(arena_s* arena);
+
+/**
+   \brief sets the current arena of the calling thread (\c NULL to allocate
+   with \c malloc) and returns the previous one
+*/
+arena_s* arena_use(arena_s* arena);
+
+/**
+   \brief allocates \c n cleared bytes of scratch memory, which is valid
+   until the \c scratch_release of a mark taken before.
+
+   Each thread has its own scratch arena, separate from the current arena,
+   so that the buffers used only during a function can be released at its
+   end, even if the function has allocated some memory that must survive.
+   \c scratch_arena can be made the current arena to allocate larger scratch
+   objects.
+*/
+void* xmalloc_scratch(size_t n);
+arena_mark_s scratch_mark(void);
+void scratch_release(arena_mark_s mark);
+arena_s* scratch_arena(void);
+#endif
@@ -24,6 +24,44 @@
 
 */
 #include "perfect_phylogeny.h"
+#include <time.h>
+
+static uint32_t red_black_representation = GRAPH_DENSE;
+static uint32_t conflict_representation = GRAPH_DENSE;
+
+static bool phase_timing = false;
+static _Thread_local double phase_seconds[NUM_PHASES];
+
+double
+monotonic_seconds(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+   \brief the start of a phase, to be passed to \c phase_end
+*/
+static inline double
+phase_start(void) {
+        return phase_timing ? monotonic_seconds() : 0.0;
+}
+
+static inline void
+phase_end(uint32_t phase, double start) {
+        if (phase_timing)
+                phase_seconds[phase] += monotonic_seconds() - start;
+}
+
+/**
+   \brief the number of vertices represented by the vertex \c v of the
+   red-black graph, that is the multiplicity of a species that has not been
+   deleted, and 1 for all other vertices
+*/
+static inline uint32_t
+vertex_weight(const state_s* stp, uint32_t v) {
+        return (v < stp->num_species_orig && bitmap_get_bit(stp->species, v)) ? stp->species_multiplicity[v] : 1;
+}
 
 /**
    Pretty print a state.
@@ -45,14 +83,14 @@ log_state(const state_s* stp) {
         fprintf(stderr, "  c   |characters|colors\n");
         fprintf(stderr, "------|----------|------\n");
         for (size_t i = 0; i < stp->num_characters_orig; i++)
-                fprintf(stderr, "%6d|%10d|%6d\n", i,stp->characters[i], stp->colors[i]);
+                fprintf(stderr, "%6d|%10d|%6d\n", i, bitmap_get_bit(stp->characters, i), stp->colors[i]);
         fprintf(stderr, "------|-------|----------|------\n");
 
         fprintf(stderr, "------|-------\n");
         fprintf(stderr, "  s   |species\n");
         fprintf(stderr, "------|-------\n");
         for (size_t i = 0; i < stp->num_species_orig; i++) {
-                fprintf(stderr, "%6d|%7d\n", i, stp->species[i]);
+                fprintf(stderr, "%6d|%7d\n", i, bitmap_get_bit(stp->species, i));
         }
 
         fprintf(stderr, "------|-------\n");
@@ -63,7 +101,7 @@ log_state(const state_s* stp) {
         fprintf(stderr, "connected_components: size %d\n", stp->red_black->num_vertices);
         log_array_uint32_t("connected_components", stp->connected_components, stp->red_black->num_vertices);
 
-        log_array_bool("current_component", stp->current_component, stp->red_black->num_vertices);
+        log_bitmap("current_component", stp->current_component, stp->red_black->num_vertices);
         fprintf(stderr, "\n");
 
 
@@ -97,15 +135,12 @@ void log_state_graphs(const state_s* stp) {
    \brief some functions to abstract the access to the instance matrix
 */
 
+#ifdef DEBUG
 static uint32_t
 matrix_get_value(state_s *stp, uint32_t s, uint32_t c) {
-        return stp->matrix[c + stp->num_characters * s];
-}
-
-static void
-matrix_set_value(state_s *stp, uint32_t s, uint32_t c, uint32_t value) {
-        stp->matrix[c + stp->num_characters * s] = value;
+        return bitmap_get_bit(stp->matrix + s * BITMAP_NWORDS(stp->num_characters_orig), c);
 }
+#endif
 
 static uint32_t
 state_cmp(const state_s *stp1, const state_s *stp2) {
@@ -131,11 +166,11 @@ state_cmp(const state_s *stp1, const state_s *stp2) {
 
         if (stp1->species == NULL || stp2->species == NULL)
                 return 7;
-        if (memcmp(stp1->species, stp2->species, (stp2->num_species_orig) * sizeof((stp1->species)[0])) != 0)
+        if (memcmp(stp1->species, stp2->species, bitmap_sizeof(stp2->num_species_orig)) != 0)
                 return 8;
         if (stp1->characters == NULL || stp2->characters == NULL)
                 return 9;
-        if (memcmp(stp1->characters, stp2->characters, (stp2->num_characters_orig) * sizeof((stp1->characters)[0])) != 0)
+        if (memcmp(stp1->characters, stp2->characters, bitmap_sizeof(stp2->num_characters_orig)) != 0)
                 return 10;
         if (stp1->character_queue_size > 0 && stp1->character_queue == NULL)
                 return 12;
@@ -166,12 +201,12 @@ state_cmp(const state_s *stp1, const state_s *stp2) {
                 return 21;
         if (stp1->current_component == NULL || stp2->current_component == NULL)
                 return 22;
-        if (memcmp(stp2->current_component, stp2->current_component, ((stp2->num_characters_orig) + (stp2->num_species_orig)) * sizeof((stp2->current_component)[0])) != 0)
+        if (memcmp(stp2->current_component, stp2->current_component, bitmap_sizeof(stp2->num_characters_orig + stp2->num_species_orig)) != 0)
                 return 23;
 
         if (stp1->matrix == NULL || stp2->matrix == NULL)
                 return 22;
-        if (memcmp(stp1->matrix, stp2->matrix, ((stp2->num_characters) * (stp2->num_species)) * sizeof((stp1->matrix)[0])) != 0)
+        if (memcmp(stp1->matrix, stp2->matrix, (stp2->num_species_orig) * BITMAP_NWORDS(stp2->num_characters_orig) * sizeof((stp1->matrix)[0])) != 0)
                 return 23;
 
         if (stp1->red_black == NULL || stp2->red_black == NULL)
@@ -195,24 +230,25 @@ copy_state(state_s* dst, const state_s* src) {
         dst->realize = src->realize;
         dst->num_species = src->num_species;
         dst->num_characters = src->num_characters;
-        graph_copy(dst->red_black, src->red_black);
-        graph_copy(dst->conflict, src->conflict);
         dst->matrix = src->matrix;
-        assert(dst != NULL);
-
-        assert(dst->characters != NULL);
-        assert(dst->colors != NULL);
-        assert(dst->species != NULL);
-        memcpy(dst->characters, src->characters, src->num_characters_orig * sizeof(src->characters[0]));
-        memcpy(dst->colors, src->colors, src->num_characters_orig * sizeof(src->colors[0]));
-        memcpy(dst->species, src->species, src->num_species_orig * sizeof(src->species[0]));
-
+        dst->species_multiplicity = src->species_multiplicity;
+        assert(dst->data != NULL);
+        assert(dst->copied_bytes == src->copied_bytes);
+/*
+  If both states have their own graphs, the graphs are at the beginning of
+  the block, just before the arrays, and everything is copied at once.
+*/
+        if (dst->red_black != src->red_black && dst->graph_bytes > 0 && dst->graph_bytes == src->graph_bytes) {
+                memcpy(dst->data, src->data, src->graph_bytes + src->copied_bytes);
+        } else {
+                if (dst->red_black != src->red_black)
+                        graph_copy(dst->red_black, src->red_black);
+                if (dst->conflict != src->conflict)
+                        graph_copy(dst->conflict, src->conflict);
+                memcpy((char*) dst->data + dst->graph_bytes, (const char*) src->data + src->graph_bytes, src->copied_bytes);
+        }
         dst->operation = src->operation;
-
-        assert(dst->connected_components != NULL);
-        assert(dst->current_component != NULL);
-        memcpy(dst->connected_components, src->connected_components, src->red_black->num_vertices * sizeof(src->connected_components[0]));
-        memcpy(dst->current_component, src->current_component, src->red_black->num_vertices * sizeof(src->current_component[0]));
+        dst->num_components = src->num_components;
 
         dst->tried_characters_size = 0;
         dst->character_queue_size = 0;
@@ -251,15 +287,15 @@ realize_character(state_s* dst, state_s* src) {
         copy_state(dst, src);
         assert(state_cmp(src, dst) == 0);
         uint32_t character = src->realize;
-        assert(src->characters[character]);
+        assert(bitmap_get_bit(src->characters, character));
         uint32_t n = src->num_species_orig;
 
         log_debug("realize_character: Trying to realize CHAR %d", character);
         check_state(dst);
         uint32_t character_vertex = src->num_species_orig + character;
-        assert(src->current_component[character_vertex]);
+        assert(bitmap_get_bit(src->current_component, character_vertex));
         uint32_t color = src->colors[character];
-        log_array_bool("realize_character: src->current_component: ", src->current_component, src->red_black->num_vertices);
+        log_bitmap("realize_character: src->current_component: ", src->current_component, src->red_black->num_vertices);
         log_debug("realize_character: check dst");
         log_debug("realize_character: color %d. Cases BLACK=>%d RED=>%d", color, (color == BLACK), (color == RED));
         check_state(dst);
@@ -270,12 +306,11 @@ realize_character(state_s* dst, state_s* src) {
   for each species s in the same connected component as c, delete the
   edge (s,c) if it exists and create the edge (s,c) if it does not exist
 */
-                for (uint32_t v=0; v<n; v++)
-                        if (src->current_component[v])
-                                if (graph_get_edge(src->red_black, character_vertex, v) && character_vertex != v)
-                                        graph_del_edge(dst->red_black, character_vertex, v);
-                                else
-                                        graph_add_edge(dst->red_black, character_vertex, v);
+                for (uint32_t v = bitmap_next_set(src->current_component, n, 0); v < n; v = bitmap_next_set(src->current_component, n, v + 1))
+                        if (graph_get_edge(src->red_black, character_vertex, v) && character_vertex != v)
+                                graph_del_edge(dst->red_black, character_vertex, v);
+                        else
+                                graph_add_edge(dst->red_black, character_vertex, v);
 
                 src->operation = 1;
                 dst->colors[character] = RED;
@@ -289,17 +324,16 @@ realize_character(state_s* dst, state_s* src) {
   If c is adjacent to all species in its connected component, remove
   all edges incident on c, because c is free.
 */
-                for (uint32_t v=0; v<n; v++)
-                        if (src->current_component[v])
-                                if (graph_get_edge(src->red_black, character_vertex, v) && character_vertex != v) {
-                                        src->operation = 2;
-                                        dst->colors[character] = RED + 1;
-                                        graph_del_edge(dst->red_black, character_vertex, v);
-                                } else {
-                                        src->operation = 0;
-                                        log_debug("realize_character: end. REALIZATION IMPOSSIBLE");
-                                        return false;
-                                }
+                for (uint32_t v = bitmap_next_set(src->current_component, n, 0); v < n; v = bitmap_next_set(src->current_component, n, v + 1))
+                        if (graph_get_edge(src->red_black, character_vertex, v) && character_vertex != v) {
+                                src->operation = 2;
+                                dst->colors[character] = RED + 1;
+                                graph_del_edge(dst->red_black, character_vertex, v);
+                        } else {
+                                src->operation = 0;
+                                log_debug("realize_character: end. REALIZATION IMPOSSIBLE");
+                                return false;
+                        }
         }
 
         dst->realize = character;
@@ -307,11 +341,11 @@ realize_character(state_s* dst, state_s* src) {
         check_state(dst);
         cleanup(dst);
         check_state(dst);
-        log_debug("realize_character: call update_connected_components");
-        update_connected_components(dst);
+        log_debug("realize_character: call update_component");
+        update_component(dst, src->current_component);
         check_state(dst);
-        log_debug("realize_character: update_conflict_graph");
-        update_conflict_graph(dst);
+        log_debug("realize_character: update_conflict_graph_component");
+        update_conflict_graph_component(dst, src->current_component);
         check_state(dst);
         log_debug("realize_character: color %d", color);
         log_debug("realize_character: outcome %d (1=>activated, 2=>freed)", dst->operation);
@@ -327,10 +361,12 @@ realize_character(state_s* dst, state_s* src) {
 
    \c stp is a pointer to an existing state
 
-   Reads an instance from file. If \c global_props contains a \c NULL \c file,
+   Reads an instance from file. If \c global_props contains a \c NULL \c reader,
    then also the first row of the file, storing the number of species and
    characters must be read.
    If the file contains no instances to be read, then the function returns \c NULL.
+   A malformed instance terminates the program, reporting the line and the
+   column of the error.
 
    Updates an instance by computing the red-black and the conflict graphs
    associated to a given matrix.
@@ -344,43 +380,271 @@ realize_character(state_s* dst, state_s* src) {
    or \c RED (at the beginning, there can only be \c BLACK edges).
 
 */
-bool
-read_instance_from_filename(instances_schema_s* global_props, state_s* stp) {
+/**
+   \brief opens the file of \c global_props and reads the number of species
+   and characters, from the header of a binary file or from the first row of a
+   text file. Both numbers must be positive.
+   The reader and the header are not allocated in the current arena, since
+   they are used by all instances.
+*/
+static void
+open_instances(instances_schema_s* global_props) {
         assert(global_props->filename != NULL);
         log_debug("Reading data from:%s\n", global_props->filename);
-        if (global_props->file == NULL) {
-                global_props->file = fopen(global_props->filename, "r");
-                assert(global_props->file != NULL);
-                if (feof(global_props->file))
-                        error(3, 0, "Could not open input file: %s\n", global_props->filename);
-
-                int err = fscanf(global_props->file, "%"SCNu32" %"SCNu32, &(global_props->num_species),
-                                 &(global_props->num_characters));
-                if (err == EOF)
-                        error(1, 0, "Could not read the first line of file: %s\n", global_props->filename);
-        }
-
-        init_state(stp, global_props->num_species, global_props->num_characters);
-        stp->num_species = global_props->num_species;
-        stp->num_characters = global_props->num_characters;
-        stp->matrix = GC_MALLOC_ATOMIC(stp->num_species * stp->num_characters * sizeof(uint32_t));
-        assert(stp->matrix != NULL);
-        for(uint32_t s=0; s < stp->num_species; s++)
-                for(uint32_t c=0; c < stp->num_characters; c++) {
-                        uint32_t x = -1;
-                        int err = fscanf(global_props->file, "%"SCNu32, &x);
+        arena_s* arena = arena_use(NULL);
+        global_props->reader = reader_open(global_props->filename);
+        global_props->binary = NULL;
+        global_props->next_instance = 0;
+        if (binary_file_p(global_props->reader))
+                global_props->binary = binary_read_header(global_props->reader);
+        arena_use(arena);
+        if (global_props->binary != NULL) {
+                global_props->num_species = global_props->binary->num_species;
+                global_props->num_characters = global_props->binary->num_characters;
+                return;
+        }
+        if (!reader_next_token(global_props->reader))
+                error(1, 0, "Could not read the first line of file: %s\n", global_props->filename);
+        global_props->num_species = reader_read_uint(global_props->reader);
+        if (global_props->num_species == 0)
+                reader_error(global_props->reader, "the number of species must be positive");
+        if (reader_end_of_line(global_props->reader))
+                reader_error(global_props->reader, "missing number of characters");
+        global_props->num_characters = reader_read_uint(global_props->reader);
+        if (global_props->num_characters == 0)
+                reader_error(global_props->reader, "the number of characters must be positive");
+}
+
+/**
+   \brief reads the next matrix of a text file. The value of each cell is
+   stored in \c cells (in row-major order) if it is not \c NULL. If \c stp
+   is not \c NULL, the state is initialized and the matrix and the
+   red-black graph are updated while reading the cells.
+
+   \return \c false if there are no more instances
+*/
+static bool
+read_text_matrix(instances_schema_s* global_props, state_s* stp, uint8_t* cells) {
+        reader_s* rp = global_props->reader;
+        if (!reader_next_token(rp)) {
+                log_debug("Read instance: EOF");
+                reader_close(rp);
+                return false;
+        }
+
+        uint32_t n = global_props->num_species;
+        uint32_t m = global_props->num_characters;
 /*
-  Check that the file is not ended in the middle of an instance
+  A matrix without cells would not consume any token, and the same token
+  would be read forever
 */
-                        if (err == EOF && (s != 0 || c != 0))
-                                error(2, 0, "Badly formatted input file: %s\n", global_props->filename);
-                        if (feof(global_props->file)) {
-                                log_debug("Read instance: EOF");
-                                fclose(global_props->file);
-                                return false;
+        if (n == 0 || m == 0)
+                reader_error(rp, "the matrix has no cells");
+        uint32_t row_words = BITMAP_NWORDS(m);
+        if (stp != NULL) {
+                init_state(stp, n, m);
+                stp->matrix = xmalloc_atomic(n * row_words * sizeof(bitmap_word));
+                assert(stp->matrix != NULL);
+                memset(stp->matrix, 0, n * row_words * sizeof(bitmap_word));
+        }
+/*
+  Each species is a line of the file
+*/
+        for(uint32_t s=0; s < n; s++) {
+                if (s > 0 && !reader_next_token(rp))
+                        reader_error(rp, "the instance has %"PRIu32" species instead of %"PRIu32, s, n);
+                for(uint32_t c=0; c < m; c++) {
+                        if (reader_end_of_line(rp))
+                                reader_error(rp, "species %"PRIu32" has %"PRIu32" characters instead of %"PRIu32, s, c, m);
+                        uint8_t x = reader_read_cell(rp);
+                        if (cells != NULL)
+                                cells[s * m + c] = x;
+                        if (stp != NULL && x == 1) {
+                                bitmap_set_bit(stp->matrix + s * row_words, c);
+                                graph_add_edge(stp->red_black, s, c + n);
                         }
-                        matrix_set_value(stp, s, c, x);
                 }
+                if (!reader_end_of_line(rp))
+                        reader_error(rp, "species %"PRIu32" has more than %"PRIu32" characters", s, m);
+        }
+/*
+  An instance whose last line is not terminated by a newline is considered
+  incomplete, and it is ignored
+*/
+        if (reader_end_of_file(rp)) {
+                log_debug("Read instance: the last line is not terminated");
+                reader_close(rp);
+                return false;
+        }
+        return true;
+}
+
+/**
+   \brief reads the next matrix of a binary file, initializing the state \c
+   stp. When each cell is stored in a single bit, the rows in the mapped
+   file are the matrix of the state.
+
+   \return \c false if there are no more instances
+*/
+static bool
+read_binary_matrix(instances_schema_s* global_props, state_s* stp) {
+        if (global_props->next_instance == global_props->binary->num_instances) {
+                log_debug("Read instance: no more instances");
+                reader_close(global_props->reader);
+                return false;
+        }
+        uint32_t n = global_props->num_species;
+        uint32_t m = global_props->num_characters;
+        uint32_t cell_bits;
+        bitmap_word* rows = binary_instance_rows(global_props->reader, global_props->binary, global_props->next_instance++, &cell_bits);
+        init_state(stp, n, m);
+        uint32_t row_words = BITMAP_NWORDS(m);
+        if (cell_bits == 1) {
+                stp->matrix = rows;
+        } else {
+                stp->matrix = xmalloc_atomic(n * row_words * sizeof(bitmap_word));
+                assert(stp->matrix != NULL);
+                memset(stp->matrix, 0, n * row_words * sizeof(bitmap_word));
+                for(uint32_t s=0; s < n; s++)
+                        for(uint32_t c=0; c < m; c++)
+                                if (binary_cell(rows, m, cell_bits, s, c) == 1)
+                                        bitmap_set_bit(stp->matrix + s * row_words, c);
+        }
+        for(uint32_t s=0; s < n; s++)
+                for(uint32_t c = bitmap_next_set(stp->matrix + s * row_words, m, 0); c < m;
+                    c = bitmap_next_set(stp->matrix + s * row_words, m, c + 1))
+                        graph_add_edge(stp->red_black, s, c + n);
+        return true;
+}
+
+bool
+read_instance_cells(instances_schema_s* global_props, uint8_t* cells) {
+        if (global_props->reader == NULL)
+                open_instances(global_props);
+        if (global_props->binary == NULL)
+                return read_text_matrix(global_props, NULL, cells);
+
+        if (global_props->next_instance == global_props->binary->num_instances) {
+                reader_close(global_props->reader);
+                return false;
+        }
+        uint32_t n = global_props->num_species;
+        uint32_t m = global_props->num_characters;
+        uint32_t cell_bits;
+        bitmap_word* rows = binary_instance_rows(global_props->reader, global_props->binary, global_props->next_instance++, &cell_bits);
+        for(uint32_t s=0; s < n; s++)
+                for(uint32_t c=0; c < m; c++)
+                        cells[s * m + c] = binary_cell(rows, m, cell_bits, s, c);
+        return true;
+}
+
+void
+convert_instances(instances_schema_s* global_props, FILE* out, bool binary) {
+        if (global_props->reader == NULL)
+                open_instances(global_props);
+        uint32_t n = global_props->num_species;
+        uint32_t m = global_props->num_characters;
+        assert(n > 0 && m > 0);
+        uint8_t* cells = xmalloc_atomic((size_t) n * m + 1);
+        assert(cells != NULL);
+        binary_writer_s* wp = NULL;
+        if (binary)
+                wp = binary_writer_open(out, n, m);
+        else
+                fprintf(out, "%"PRIu32" %"PRIu32"\n", n, m);
+        while (read_instance_cells(global_props, cells)) {
+                if (binary) {
+                        binary_write_instance(wp, cells);
+                        continue;
+                }
+                fprintf(out, "\n");
+                for(uint32_t s=0; s < n; s++) {
+                        for(uint32_t c=0; c < m; c++) {
+                                fputc('0' + cells[s * m + c], out);
+                                fputc(' ', out);
+                        }
+                        fputc('\n', out);
+                }
+        }
+        if (binary)
+                binary_writer_close(wp);
+}
+
+/**
+   \brief finds the duplicates among the \c k bitmaps \c rows, each stored in
+   \c nwords words: \c first[i] is set to the smallest \c j such that the
+   bitmaps \c i and \c j are equal.
+
+   The bitmaps are stored in an open addressing hash table, and two bitmaps
+   are compared only if they have the same hash.
+*/
+static void
+find_duplicates(const bitmap_word* rows, uint32_t k, uint32_t nwords, uint32_t* first) {
+        uint32_t size = 1;
+        while (size < 2 * k)
+                size *= 2;
+        uint32_t table[size];
+        uint64_t hashes[k + 1];
+        memset(table, 0xff, size * sizeof(uint32_t));
+        for (uint32_t i = 0; i < k; i++) {
+                const bitmap_word* row = rows + i * nwords;
+                hashes[i] = bitmap_hash(row, nwords);
+                uint32_t slot = hashes[i] & (size - 1);
+                for (; table[slot] != -1; slot = (slot + 1) & (size - 1)) {
+                        uint32_t j = table[slot];
+                        if (hashes[j] == hashes[i] && memcmp(rows + j * nwords, row, nwords * sizeof(bitmap_word)) == 0)
+                                break;
+                }
+                if (table[slot] == -1)
+                        table[slot] = i;
+                first[i] = table[slot];
+        }
+}
+
+/**
+   \brief collapses each class of identical species into its first species.
+
+   The other species of the class are isolated and deleted, while the
+   multiplicity of the first species is increased. Since the leaves of the
+   phylogeny are not labeled and identical species remain identical after
+   each realization, the decision tree and the phylogeny do not change.
+*/
+static void
+collapse_duplicate_species(state_s* stp) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        uint32_t nwords = BITMAP_NWORDS(m);
+        uint32_t species[n];
+        uint32_t k = 0;
+        for (uint32_t s = bitmap_next_set(stp->species, n, 0); s < n; s = bitmap_next_set(stp->species, n, s + 1))
+                species[k++] = s;
+        bitmap_word* rows = xmalloc((k * nwords + 1) * sizeof(bitmap_word));
+        memset(rows, 0, k * nwords * sizeof(bitmap_word));
+        for (uint32_t i = 0; i < k; i++)
+                for (uint32_t c = graph_next_neighbor(stp->red_black, species[i], n); c < n + m; c = graph_next_neighbor(stp->red_black, species[i], c + 1))
+                        bitmap_set_bit(rows + i * nwords, c - n);
+        uint32_t first[k + 1];
+        find_duplicates(rows, k, nwords, first);
+        for (uint32_t i = 0; i < k; i++)
+                if (first[i] != i) {
+                        log_debug("collapse_duplicate_species: species %d is equal to %d", species[i], species[first[i]]);
+                        stp->species_multiplicity[species[first[i]]] += stp->species_multiplicity[species[i]];
+                        graph_isolate_vertex(stp->red_black, species[i]);
+                        delete_species(stp, species[i]);
+                }
+}
+
+bool
+read_instance_from_filename(instances_schema_s* global_props, state_s* stp) {
+        if (global_props->reader == NULL)
+                open_instances(global_props);
+        if (global_props->binary != NULL) {
+                if (!read_binary_matrix(global_props, stp))
+                        return false;
+        } else if (!read_text_matrix(global_props, stp, NULL))
+                return false;
+        for (uint32_t s = 0; s < stp->num_species_orig; s++)
+                stp->species_multiplicity[s] = 1;
 #ifdef DEBUG
         log_debug("MATRIX");
         for(uint32_t s=0; s < stp->num_species; s++) {
@@ -389,24 +653,20 @@ read_instance_from_filename(instances_schema_s* global_props, state_s* stp) {
                 fprintf(stderr, "\n");
         }
 #endif
-        /* red-black graph */
-        for(uint32_t s=0; s < stp->num_species; s++)
-                for(uint32_t c=0; c < stp->num_characters; c++)
-                        if (matrix_get_value(stp, s, c) == 1)
-                                graph_add_edge(stp->red_black, s, c + stp->num_species);
 #ifdef DEBUG
         log_debug("MATRIX");
         graph_pp(stp->red_black);
-#endif
         /* check the red-black graph */
         for(uint32_t s=0; s < stp->num_species; s++)
                 for(uint32_t c=0; c < stp->num_characters; c++)
                         assert(matrix_get_value(stp, s, c) == 0 && !graph_get_edge(stp->red_black, s, c + stp->num_species) ||
                                matrix_get_value(stp, s, c) == 1 && graph_get_edge(stp->red_black, s, c + stp->num_species));
+#endif
         update_connected_components(stp);
         check_state(stp);
         cleanup(stp);
         check_state(stp);
+        collapse_duplicate_species(stp);
         log_debug("read_instance_from_filename: call update_connected_components");
         update_connected_components(stp);
         check_state(stp);
@@ -435,23 +695,29 @@ read_instance_from_filename(instances_schema_s* global_props, state_s* stp) {
 void cleanup(state_s *stp) {
         assert(stp != NULL);
         log_debug("cleanup");
+        double start = phase_start();
         log_state(stp);
         // Looking for null species
-        for (uint32_t s=0; s < stp->num_species_orig; s++)
-                if (stp->species[s] && graph_degree(stp->red_black, s) == 0) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        for (uint32_t s = bitmap_next_set(stp->species, n, 0); s < n; s = bitmap_next_set(stp->species, n, s + 1))
+                if (graph_degree(stp->red_black, s) == 0) {
                         log_debug("Want to delete species %d\n", s);
                         delete_species(stp, s);
                 }
 // Looking for null characters
-        for (uint32_t c = 0; c < stp->num_characters_orig; c++)
-                if (stp->characters[c] && graph_degree(stp->red_black, c + stp->num_species_orig) == 0) {
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (graph_degree(stp->red_black, c + n) == 0) {
 
                         log_debug("Want to delete character %d\n", c);
                         delete_character(stp, c);
                 }
-/* TODO (if necessary) */
-/* we remove duplicated characters */
-/* we remove duplicated species */
+/*
+  Duplicated species are collapsed by collapse_duplicate_species when the
+  instance is read, while duplicated characters are skipped by
+  smallest_component
+*/
+        phase_end(PHASE_CLEANUP, start);
         log_debug("cleanup: final state");
         log_state(stp);
         log_debug("cleanup: end");
@@ -471,37 +737,168 @@ get_conflict_graph(const state_s *inst) {
 
 
 void
-init_state(state_s *stp, uint32_t n, uint32_t m) {
+set_graph_representations(uint32_t red_black, uint32_t conflict) {
+        assert(conflict != GRAPH_BIPARTITE);
+        red_black_representation = red_black;
+        conflict_representation = conflict;
+}
+
+void
+set_phase_timing(bool enabled) {
+        phase_timing = enabled;
+}
+
+void
+phase_times(double *seconds) {
+        memcpy(seconds, phase_seconds, NUM_PHASES * sizeof(double));
+}
+
+/**
+   \brief the alignment of the arrays in the block of a state, that is a
+   cache line
+*/
+#define STATE_ALIGNMENT 64
+
+static size_t
+state_align(size_t offset) {
+        return (offset + STATE_ALIGNMENT - 1) & ~((size_t) STATE_ALIGNMENT - 1);
+}
+
+/**
+   \brief returns \c *offset and moves it after \c bytes bytes, aligned.
+   If the new offset does not fit in a \c size_t, \c *offset becomes \c
+   SIZE_MAX, and it remains so.
+*/
+static size_t
+state_place(size_t *offset, size_t bytes) {
+        size_t start = *offset;
+        if (start > SIZE_MAX - STATE_ALIGNMENT || bytes > SIZE_MAX - STATE_ALIGNMENT - start)
+                *offset = SIZE_MAX;
+        else
+                *offset = state_align(start + bytes);
+        return start;
+}
+
+/**
+   \struct state_layout_s
+   \brief the offsets of the arrays in the block of a state (see \c state_s)
+*/
+typedef struct state_layout_s {
+        size_t red_black;
+        size_t conflict;
+        size_t species;
+        size_t characters;
+        size_t current_component;
+        size_t connected_components;
+        size_t component_size;
+        size_t component_species;
+        size_t colors;
+        size_t tried_characters;
+        size_t character_queue;
+        size_t character_representative;
+        size_t species_multiplicity;
+        size_t graphs;
+        size_t graph_bytes;
+        size_t copied_bytes;
+        size_t size;
+} state_layout_s;
+
+static state_layout_s
+state_layout(uint32_t n, uint32_t m, bool own_graphs) {
+        state_layout_s l;
+        size_t offset = 0;
+        size_t red_black_bytes = 0;
+        size_t conflict_bytes = 0;
+        if (own_graphs) {
+                if (red_black_representation == GRAPH_BIPARTITE)
+                        red_black_bytes = graph_bipartite_data_size(n, m);
+                else
+                        red_black_bytes = ((uint64_t) n + m > UINT32_MAX) ? SIZE_MAX : graph_data_size(n + m, red_black_representation);
+                conflict_bytes = graph_data_size(m, conflict_representation);
+        }
+        l.red_black = state_place(&offset, red_black_bytes);
+        l.conflict = state_place(&offset, conflict_bytes);
+        l.graph_bytes = offset;
+        l.species = state_place(&offset, bitmap_sizeof(n));
+        l.characters = state_place(&offset, bitmap_sizeof(m));
+        l.current_component = state_place(&offset, bitmap_sizeof((size_t) n + m));
+        l.connected_components = state_place(&offset, ((size_t) n + m) * sizeof(uint32_t));
+        l.component_size = state_place(&offset, ((size_t) n + m) * sizeof(uint32_t));
+        l.component_species = state_place(&offset, ((size_t) n + m) * sizeof(uint32_t));
+        l.colors = state_place(&offset, m * sizeof(uint8_t));
+        l.copied_bytes = offset - l.graph_bytes;
+        l.tried_characters = state_place(&offset, m * sizeof(uint32_t));
+        l.character_queue = state_place(&offset, m * sizeof(uint32_t));
+        l.character_representative = state_place(&offset, m * sizeof(uint32_t));
+        l.species_multiplicity = state_place(&offset, n * sizeof(uint32_t));
+        l.graphs = state_place(&offset, own_graphs ? 2 * sizeof(graph_s) : 0);
+        l.size = offset;
+        return l;
+}
+
+/**
+   \brief initializes a state with \c n species and \c m characters, whose
+   red-black and conflict graphs are \c red_black and \c conflict. If \c
+   red_black is \c NULL, the state has its own graphs, stored in its block.
+
+   The block is allocated with some slack, so that it can be aligned to a
+   cache line. A state whose size does not fit in a \c size_t is reported
+   as insufficient memory.
+*/
+static void
+init_state_graphs(state_s *stp, uint32_t n, uint32_t m, graph_s *red_black, graph_s *conflict) {
         log_debug("init_state n=%d m=%d", n, m);
         assert(stp != NULL);
+        state_layout_s l = state_layout(n, m, red_black == NULL);
+        if (l.size > SIZE_MAX - STATE_ALIGNMENT)
+                error(EXIT_FAILURE, 0, "insufficient memory: a state with %"PRIu32" species and %"PRIu32" characters is too large", n, m);
+        char *data = (char*) state_align((uintptr_t) xmalloc(l.size + STATE_ALIGNMENT));
+        stp->data = data;
+        stp->graph_bytes = l.graph_bytes;
+        stp->copied_bytes = l.copied_bytes;
         stp->num_characters_orig = m;
         stp->num_species_orig = n;
         stp->num_characters = m;
         stp->num_species = n;
         stp->realize = 0;
-        stp->species = xmalloc(n * sizeof(bool));
-        stp->characters = xmalloc(m * sizeof(bool));
-        stp->colors = xmalloc(m * sizeof(uint8_t));
-
-        stp->tried_characters = xmalloc(m * sizeof(uint32_t));
-        stp->character_queue = xmalloc(m * sizeof(uint32_t));
-        stp->connected_components = xmalloc((m + n) * sizeof(uint32_t));
-        stp->current_component = xmalloc((m + n) * sizeof(bool));
+        stp->species = (bitmap_word*) (data + l.species);
+        stp->characters = (bitmap_word*) (data + l.characters);
+        stp->colors = (uint8_t*) (data + l.colors);
+
+        stp->tried_characters = (uint32_t*) (data + l.tried_characters);
+        stp->character_queue = (uint32_t*) (data + l.character_queue);
+        stp->connected_components = (uint32_t*) (data + l.connected_components);
+        stp->component_size = (uint32_t*) (data + l.component_size);
+        stp->component_species = (uint32_t*) (data + l.component_species);
+        stp->current_component = (bitmap_word*) (data + l.current_component);
+        stp->species_multiplicity = (uint32_t*) (data + l.species_multiplicity);
+        stp->character_representative = (uint32_t*) (data + l.character_representative);
         stp->operation = 0;
 
-        stp->red_black = graph_new(n + m);
-        assert(stp->red_black != NULL);
-        stp->conflict = graph_new(m);
-        assert(stp->conflict != NULL);
+        if (red_black == NULL) {
+                red_black = (graph_s*) (data + l.graphs);
+                conflict = red_black + 1;
+                if (red_black_representation == GRAPH_BIPARTITE)
+                        graph_init_bipartite(red_black, n, m, data + l.red_black);
+                else
+                        graph_init_representation(red_black, n + m, red_black_representation, data + l.red_black);
+                graph_init_representation(conflict, m, conflict_representation, data + l.conflict);
+        }
+        stp->red_black = red_black;
+        stp->conflict = conflict;
+        stp->trail = NULL;
+        stp->trail_mark = 0;
 
         for (uint32_t i=0; i < n; i++) {
-                stp->species[i] = true;
+                bitmap_set_bit(stp->species, i);
+                stp->species_multiplicity[i] = 1;
         }
 
         for (uint32_t i=0; i < m; i++) {
+                stp->character_representative[i] = i;
                 stp->tried_characters[i] = -1;
                 stp->character_queue[i] = -1;
-                stp->characters[i] = true;
+                bitmap_set_bit(stp->characters, i);
                 stp->colors[i] = BLACK;
         }
         stp->character_queue_size = 0;
@@ -514,6 +911,24 @@ init_state(state_s *stp, uint32_t n, uint32_t m) {
         check_state(stp);
 }
 
+void
+init_state(state_s *stp, uint32_t n, uint32_t m) {
+        init_state_graphs(stp, n, m, NULL, NULL);
+}
+
+void
+init_shared_state(state_s *stp, state_s *shared) {
+        log_debug("init_shared_state");
+        if (shared->trail == NULL) {
+                shared->trail = graph_trail_new();
+                shared->trail_mark = 0;
+                graph_set_trail(shared->red_black, shared->trail);
+                graph_set_trail(shared->conflict, shared->trail);
+        }
+        init_state_graphs(stp, shared->num_species_orig, shared->num_characters_orig, shared->red_black, shared->conflict);
+        stp->trail = shared->trail;
+}
+
 void
 check_state(const state_s* stp) {
         uint32_t err = 0;
@@ -529,7 +944,7 @@ check_state(const state_s* stp) {
 
         uint32_t count = 0;
         for (uint32_t s = 0; s < stp->num_species_orig; s++) {
-                if (stp->species[s])
+                if (bitmap_get_bit(stp->species, s))
                         count++;
         }
         if (count != stp->num_species) {
@@ -539,7 +954,7 @@ check_state(const state_s* stp) {
 
         count = 0;
         for (uint32_t c = 0; c < stp->num_characters_orig; c++) {
-                if (stp->characters[c])
+                if (bitmap_get_bit(stp->characters, c))
                         count++;
         }
         if (count != stp->num_characters) {
@@ -569,6 +984,40 @@ check_state(const state_s* stp) {
                 }
         assert(stp->red_black != NULL);
 
+        if (max_conn + 1 != stp->num_components) {
+                err = 8;
+                log_debug("Line %d (%d != %d)", __LINE__, max_conn + 1, stp->num_components);
+        }
+        uint32_t size[max_conn + 1];
+        uint32_t species_size[max_conn + 1];
+        memset(size, 0, (max_conn + 1) * sizeof(uint32_t));
+        memset(species_size, 0, (max_conn + 1) * sizeof(uint32_t));
+        for (uint32_t v = 0; v < stp->red_black->num_vertices; v++) {
+                size[stp->connected_components[v]] += vertex_weight(stp, v);
+                if (v < stp->num_species_orig)
+                        species_size[stp->connected_components[v]]++;
+        }
+        for (uint32_t c = 0; c <= max_conn && c < stp->num_components; c++)
+                if (size[c] != stp->component_size[c] || species_size[c] != stp->component_species[c]) {
+                        err = 9;
+                        log_debug("Line %d component %d", __LINE__, c);
+                }
+
+        /* The incrementally maintained components must be the same
+           partition as the one computed from scratch */
+        uint32_t fresh[stp->red_black->num_vertices];
+        connected_components(stp->red_black, fresh);
+        uint32_t fresh_to_label[stp->red_black->num_vertices];
+        memset(fresh_to_label, 0xff, stp->red_black->num_vertices * sizeof(uint32_t));
+        for (uint32_t v = 0; v < stp->red_black->num_vertices; v++) {
+                if (fresh_to_label[fresh[v]] == -1)
+                        fresh_to_label[fresh[v]] = stp->connected_components[v];
+                if (fresh_to_label[fresh[v]] != stp->connected_components[v]) {
+                        err = 10;
+                        log_debug("Line %d vertex %d", __LINE__, v);
+                }
+        }
+
         if ((stp->num_characters_orig) + (stp->num_species_orig) != stp->red_black->num_vertices) {
                 err = 7;
                 log_debug("Line %d (%d + %d != %d)", __LINE__, stp->num_characters_orig, stp->num_species_orig, stp->red_black->num_vertices);
@@ -601,9 +1050,9 @@ void
 delete_character(state_s *stp, uint32_t c) {
         log_debug("Deleting character %d", c);
         assert(c < stp->num_characters_orig);
-        assert(stp->characters[c]);
+        assert(bitmap_get_bit(stp->characters, c));
         assert(stp->colors[c] > 0);
-        stp->characters[c] = false;
+        bitmap_clear_bit(stp->characters, c);
         (stp->num_characters)--;
 }
 
@@ -611,13 +1060,48 @@ void
 delete_species(state_s *stp, uint32_t s) {
         log_debug("Deleting species %d", s);
         assert(s < stp->num_species_orig);
-        assert(stp->species[s] > 0);
-        stp->species[s] = false;
+        assert(bitmap_get_bit(stp->species, s));
+/* From now on the species counts once in the size of its component */
+        stp->component_size[stp->connected_components[s]] -= stp->species_multiplicity[s] - 1;
+        bitmap_clear_bit(stp->species, s);
         (stp->num_species)--;
 }
 
 
 
+/**
+   \brief computes the bitmap of the species adjacent to each character of
+   \c chars in the red-black graph (the column of the character), each stored
+   in \c nwords words, in scratch memory.
+*/
+static bitmap_word*
+species_columns(const state_s* stp, const uint32_t* chars, uint32_t k, uint32_t nwords) {
+        uint32_t n = stp->num_species_orig;
+        bitmap_word* columns = xmalloc_scratch(k * nwords * sizeof(bitmap_word));
+        for (uint32_t i = 0; i < k; i++)
+                for (uint32_t s = graph_next_neighbor(stp->red_black, n + chars[i], 0); s < n; s = graph_next_neighbor(stp->red_black, n + chars[i], s + 1))
+                        bitmap_set_bit(columns + i * nwords, s);
+        return columns;
+}
+
+/**
+   \brief finds the duplicates among the inactive characters of \c
+   character_queue, setting \c character_representative, which is \c c
+   itself for the first character \c c of each class
+*/
+static void
+mark_duplicate_characters(state_s* stp, uint32_t first, uint32_t k) {
+        uint32_t nwords = BITMAP_NWORDS(stp->num_species_orig);
+        const uint32_t* chars = stp->character_queue + first;
+        arena_mark_s mark = scratch_mark();
+        bitmap_word* columns = species_columns(stp, chars, k, nwords);
+        uint32_t dup[k + 1];
+        find_duplicates(columns, k, nwords, dup);
+        scratch_release(mark);
+        for (uint32_t i = 0; i < k; i++)
+                stp->character_representative[chars[i]] = chars[dup[i]];
+}
+
 void
 smallest_component(state_s* stp) {
         assert(stp != NULL);
@@ -637,28 +1121,27 @@ smallest_component(state_s* stp) {
    Only the first character in \c character_queue can might be active: in that case the character must be adjacent to
    all species in its connected components, hence it can be freed.
 */
-        uint32_t card[stp->red_black->num_vertices];
-        memset(card, 0, stp->red_black->num_vertices * sizeof(card[0]));
-        uint32_t card_species[stp->red_black->num_vertices];
-        memset(card_species, 0, stp->red_black->num_vertices * sizeof(card[0]));
-        for (uint32_t w = 0; w < stp->red_black->num_vertices; w++) {
-                card[stp->connected_components[w]] += 1;
-                if (w < stp->num_species_orig)
-                        card_species[stp->connected_components[w]] += 1;
-        }
         uint32_t smallest_component = stp->red_black->num_vertices + 1;
         uint32_t smallest_size = stp->red_black->num_vertices + 1;
-        for (uint32_t w = 0; w < stp->num_species_orig + stp->num_characters_orig; w++)
-                if (card[w] > 1 && card[w] < smallest_size) {
-                        smallest_size = card[w];
-                        smallest_component = w;
+/*
+  Ties are broken in favor of the component with the smallest vertex, hence we
+  scan the vertices instead of the labels.
+*/
+        for (uint32_t w = 0; w < stp->num_species_orig + stp->num_characters_orig; w++) {
+                uint32_t label = stp->connected_components[w];
+                if (stp->component_size[label] > 1 && stp->component_size[label] < smallest_size) {
+                        smallest_size = stp->component_size[label];
+                        smallest_component = label;
                 }
-        uint32_t smallest_num_species = card_species[smallest_component];
+        }
+        uint32_t smallest_num_species = (smallest_component < stp->num_components) ? stp->component_species[smallest_component] : 0;
 
         log_debug("smallest_component: %d smallest_size: %d smallest_num_species: %d",
                   smallest_component, smallest_size, smallest_num_species);
+        bitmap_zero(stp->current_component, stp->red_black->num_vertices);
         for (uint32_t w = 0; w < stp->red_black->num_vertices; w++)
-                stp->current_component[w] = (stp->connected_components[w] == smallest_component);
+                if (stp->connected_components[w] == smallest_component)
+                        bitmap_set_bit(stp->current_component, w);
 
         /* Reorder the characters in the current (i.e. smallest) connected components so that an active character that
            can be freed is in the first position of \c stp->character_queue (if such an active character exists), and all
@@ -680,8 +1163,8 @@ smallest_component(state_s* stp) {
                                 }
                 }
         stp->character_queue_size = num_inactive_char;
-        log_array_uint32_t("card", card, stp->red_black->num_vertices);
-        log_array_uint32_t("card_species", card_species, stp->red_black->num_vertices);
+        log_array_uint32_t("component_size", stp->component_size, stp->num_components);
+        log_array_uint32_t("component_species", stp->component_species, stp->num_components);
         log_array_uint8_t("stp->colors", stp->colors, stp->num_characters_orig);
         log_array_uint32_t("stp->connected_components", stp->connected_components, stp->num_species_orig + stp->num_characters_orig);
         log_debug("maximum_char: %d max_degree: %d", maximum_active_char, max_degree_active);
@@ -695,38 +1178,185 @@ smallest_component(state_s* stp) {
                 stp->character_queue[num_inactive_char] = stp->character_queue[0];
                 stp->character_queue[0] = maximum_active_char;
         }
+        mark_duplicate_characters(stp, stp->character_queue_size - num_inactive_char, num_inactive_char);
         log_debug("character_queue_size: %d", stp->character_queue_size);
         log_array_uint32_t("character_queue", stp->character_queue, stp->character_queue_size);
         log_debug("smallest_component: end");
 }
 
+/**
+   \brief the number of characters in each side of the square tiles in which
+   \c update_conflict_graph partitions the pairs of characters
+*/
+#define CONFLICT_TILE 64
+
+/**
+   \brief computes the bitmap of the species of each connected component of
+   the red-black graph, each stored in \c nwords words, in scratch memory.
+
+   Only the components containing some species of \c component (or all
+   components, if \c component is \c NULL) are computed.
+*/
+static bitmap_word*
+component_species_masks(const state_s* stp, const bitmap_word* component, uint32_t nwords) {
+        uint32_t n = stp->num_species_orig;
+        bitmap_word* masks = xmalloc_scratch(stp->num_components * nwords * sizeof(bitmap_word));
+        for (uint32_t s = bitmap_next_set(stp->species, n, 0); s < n; s = bitmap_next_set(stp->species, n, s + 1))
+                if (component == NULL || bitmap_get_bit(component, s))
+                        memset(masks + stp->connected_components[s] * nwords, 0, nwords * sizeof(bitmap_word));
+        for (uint32_t s = bitmap_next_set(stp->species, n, 0); s < n; s = bitmap_next_set(stp->species, n, s + 1))
+                if (component == NULL || bitmap_get_bit(component, s))
+                        bitmap_set_bit(masks + stp->connected_components[s] * nwords, s);
+        return masks;
+}
+
+/**
+   Adds to \c conflict the edges between the pairs of characters of \c
+   component (or of all characters, if \c component is \c NULL) that are in
+   conflict. Two characters are in conflict if they are in the same
+   connected component of the red-black graph and the species of the component
+   induce the four gametes, where a species has a character iff they are
+   adjacent. Since a character is adjacent only to species of its component,
+   the test is done with bitwise operations on the columns of the two
+   characters and on the species of their component.
+
+   The pairs of characters are partitioned into square tiles of \c
+   CONFLICT_TILE characters per side. The tiles are examined in parallel, but
+   each row of \c conflicts is written only by the thread examining the tiles
+   of that row, and the conflict graph is updated afterwards.
+*/
+static void
+add_conflicts(const state_s* stp, const bitmap_word* component, graph_s* conflict) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        uint32_t chars[m];
+        uint32_t k = 0;
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (component == NULL || bitmap_get_bit(component, n + c))
+                        chars[k++] = c;
+        uint32_t nwords = BITMAP_NWORDS(n);
+        uint32_t row_words = BITMAP_NWORDS(k);
+        arena_mark_s mark = scratch_mark();
+        bitmap_word* columns = species_columns(stp, chars, k, nwords);
+        bitmap_word* masks = component_species_masks(stp, component, nwords);
+        bitmap_word* conflicts = xmalloc_scratch(k * row_words * sizeof(bitmap_word));
+
+        uint32_t num_tiles = (k + CONFLICT_TILE - 1) / CONFLICT_TILE;
+#pragma omp parallel for schedule(dynamic) if (num_tiles > 1)
+        for (uint32_t t1 = 0; t1 < num_tiles; t1++)
+                for (uint32_t t2 = t1; t2 < num_tiles; t2++)
+                        for (uint32_t i1 = t1 * CONFLICT_TILE; i1 < (t1 + 1) * CONFLICT_TILE && i1 < k; i1++) {
+                                uint32_t label = stp->connected_components[n + chars[i1]];
+                                const bitmap_word* mask = masks + label * nwords;
+                                for (uint32_t i2 = (t1 == t2) ? i1 + 1 : t2 * CONFLICT_TILE; i2 < (t2 + 1) * CONFLICT_TILE && i2 < k; i2++)
+                                        if (stp->connected_components[n + chars[i2]] == label &&
+                                            bitmap_four_gametes(columns + i1 * nwords, columns + i2 * nwords, mask, nwords))
+                                                bitmap_set_bit(conflicts + i1 * row_words, i2);
+                        }
+
+        for (uint32_t i1 = 0; i1 < k; i1++)
+                for (uint32_t i2 = bitmap_next_set(conflicts + i1 * row_words, k, i1 + 1); i2 < k;
+                     i2 = bitmap_next_set(conflicts + i1 * row_words, k, i2 + 1))
+                        graph_add_edge(conflict, chars[i1], chars[i2]);
+        scratch_release(mark);
+}
+
 void
 update_conflict_graph(state_s* stp) {
         log_debug("update_conflict_graph");
-        graph_pp(stp->conflict);
+        double start = phase_start();
         graph_nuke_edges(stp->conflict);
         log_debug("update_conflict_graph: nuked edges");
-        graph_pp(stp->conflict);
-        for(uint32_t c1 = 0; c1 < stp->num_characters; c1++)
-                for(uint32_t c2 = c1 + 1; c2 < stp->num_characters; c2++) {
-                        uint32_t states[2][2] = { {0, 0}, {0, 0} };
-                        for(uint32_t s=0; s < stp->num_species; s++)
-                                states[matrix_get_value(stp, s, c1)][matrix_get_value(stp, s, c2)] = 1;
-                        if(states[0][0] + states[0][1] + states[1][0] + states[1][1] == 4)
-                                graph_add_edge(stp->conflict, c1, c2);
-                }
+        add_conflicts(stp, NULL, stp->conflict);
+        phase_end(PHASE_CONFLICT_GRAPH, start);
         log_debug("update_conflict_graph: end");
         graph_pp(stp->conflict);
 }
 
+/**
+   Before the update, the characters of \c component can be in conflict only
+   with characters of \c component, and the characters outside \c component
+   keep their columns and the species of their connected component. Therefore
+   only the edges incident on the characters of \c component can change:
+   those edges are removed (including those of the deleted characters) and
+   the pairs of characters of \c component are tested again.
+*/
+void
+update_conflict_graph_component(state_s* stp, const bitmap_word* component) {
+        log_debug("update_conflict_graph_component");
+        double start = phase_start();
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        for (uint32_t c = bitmap_next_set(component, n + m, n); c < n + m; c = bitmap_next_set(component, n + m, c + 1))
+                graph_isolate_vertex(stp->conflict, c - n);
+        add_conflicts(stp, component, stp->conflict);
+        phase_end(PHASE_CONFLICT_GRAPH, start);
+#ifdef DEBUG
+        graph_s* full = graph_new_representation(m, conflict_representation);
+        add_conflicts(stp, NULL, full);
+        for (uint32_t c1 = 0; c1 < m; c1++)
+                for (uint32_t c2 = c1 + 1; c2 < m; c2++)
+                        if (graph_get_edge(full, c1, c2) != graph_get_edge(stp->conflict, c1, c2)) {
+                                log_debug("update_conflict_graph_component error: edge %d %d differs from the full rebuild", c1, c2);
+                                assert(false);
+                        }
+#endif
+        log_debug("update_conflict_graph_component: end");
+        graph_pp(stp->conflict);
+}
+
+/**
+   \brief recomputes \c component_size and \c component_species for the
+   labels in the range \c first_label ... \c num_components - 1 and for the
+   label of the vertices in \c component, if not \c NULL
+*/
+static void
+count_components(state_s* stp, const bitmap_word* component, uint32_t first_label) {
+        for (uint32_t l = first_label; l < stp->num_components; l++) {
+                stp->component_size[l] = 0;
+                stp->component_species[l] = 0;
+        }
+        uint32_t n = stp->red_black->num_vertices;
+        if (component != NULL)
+                for (uint32_t v = bitmap_next_set(component, n, 0); v < n; v = bitmap_next_set(component, n, v + 1)) {
+                        stp->component_size[stp->connected_components[v]] = 0;
+                        stp->component_species[stp->connected_components[v]] = 0;
+                }
+        for (uint32_t v = 0; v < n; v++)
+                if (stp->connected_components[v] >= first_label || (component != NULL && bitmap_get_bit(component, v))) {
+                        stp->component_size[stp->connected_components[v]] += vertex_weight(stp, v);
+                        if (v < stp->num_species_orig)
+                                stp->component_species[stp->connected_components[v]] += 1;
+                }
+}
+
 void
 update_connected_components(state_s* stp) {
         log_debug("update_connected_components. stp=%p", stp);
+        double start = phase_start();
         connected_components(stp->red_black, stp->connected_components);
+        stp->num_components = 0;
+        for (uint32_t v = 0; v < stp->red_black->num_vertices; v++)
+                if (stp->connected_components[v] >= stp->num_components)
+                        stp->num_components = stp->connected_components[v] + 1;
+        count_components(stp, NULL, 0);
+        phase_end(PHASE_CONNECTED_COMPONENTS, start);
         log_array_uint32_t("stp->connected_components", stp->connected_components, stp->red_black->num_vertices);
         log_debug("update_connected_components: end");
 }
 
+void
+update_component(state_s* stp, const bitmap_word* component) {
+        log_debug("update_component. stp=%p", stp);
+        double start = phase_start();
+        uint32_t first_label = stp->num_components;
+        stp->num_components = connected_components_split(stp->red_black, stp->connected_components, component, first_label);
+        count_components(stp, component, first_label);
+        phase_end(PHASE_CONNECTED_COMPONENTS, start);
+        log_array_uint32_t("stp->connected_components", stp->connected_components, stp->red_black->num_vertices);
+        log_debug("update_component: end");
+}
+
 // From 21st Century C
 #define Sasprintf(write_to, ...) {                              \
                 char *tmp_string_for_extend = (write_to);       \
@@ -749,7 +1379,7 @@ newick_levels(state_s* states, uint32_t first, uint32_t last) {
 // first state.
 // In that case, we are solving a single connected component
 // of the red-black graph.
-        if (bool_array_includes(cur->current_component, (states + last)->current_component, cur->red_black->num_vertices)) {
+        if (bitmap_includes((states + last)->current_component, cur->current_component, cur->red_black->num_vertices)) {
 // A single connected component
                 log_debug("newick_levels: 1 component. %d %d", first, last);
                 char sign = (cur->operation == 1) ? '+' : '-';
@@ -769,8 +1399,8 @@ newick_levels(state_s* states, uint32_t first, uint32_t last) {
                 if (cur_first < last) {
                         uint32_t cur_last = cur_first + 1;
                         for (;cur_last <= last; cur_last++) {
-                                if (!bool_array_includes((states + cur_first)->current_component,
-                                                         (states + cur_last)->current_component, cur->red_black->num_vertices))
+                                if (!bitmap_includes((states + cur_last)->current_component,
+                                                     (states + cur_first)->current_component, cur->red_black->num_vertices))
                                         break;
                         }
                         cur_last -= 1;
@@ -802,15 +1432,229 @@ newick(state_s* states) {
         log_debug("dump_states");
         while ((states + final_level)->num_species > 0) {
                 log_debug("%4d | %4d ", final_level, (states + final_level)->realize);
-                log_array_bool("Component.",  (states + final_level)->current_component, (states + final_level)->red_black->num_vertices);
+                log_bitmap("Component.",  (states + final_level)->current_component, (states + final_level)->red_black->num_vertices);
                 final_level += 1;
         }
         char* tmp = NULL;
         Sasprintf(tmp, "%s;", newick_levels(states, 0, final_level -1));
         log_debug("newick: tmp %s", tmp);
-        char* result = GC_MALLOC((strlen(tmp) + 1) * sizeof(char));
+        char* result = xmalloc((strlen(tmp) + 1) * sizeof(char));
         strncpy(result, tmp, strlen(tmp) + 1);
         log_debug("newick: result %s", result);
         free(tmp);
         return result;
 }
+
+#define NO_PARENT UINT32_MAX
+
+/**
+   \brief Gusfield's algorithm on the species and the characters of \c
+   component (of the whole instance, if \c component is \c NULL).
+
+   The characters are sorted by decreasing number of species with a counting
+   sort (ties are broken by index) and stored in \c order, then each species
+   visits its characters in that order: the parent of a character is the
+   previous character of each of its species, or \c NO_PARENT for a root.
+   There is a perfect phylogeny without losses iff the parent of each
+   character is the same for all its species.
+
+   \return the number of characters, or \c UINT32_MAX if there is no such
+   phylogeny, if some character is active, or if two characters are in
+   conflict, which is tested first since it is cheap.
+*/
+static uint32_t
+gusfield_tree(const state_s* stp, const bitmap_word* component, uint32_t* order, uint32_t* parent) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        uint32_t k = 0;
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (component == NULL || bitmap_get_bit(component, n + c)) {
+                        if (stp->colors[c] != BLACK || graph_degree(stp->conflict, c) > 0)
+                                return UINT32_MAX;
+                        k++;
+                }
+        arena_mark_s mark = scratch_mark();
+        uint32_t* first = xmalloc_scratch((n + 2) * sizeof(uint32_t));
+        uint32_t* last = xmalloc_scratch(n * sizeof(uint32_t));
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (component == NULL || bitmap_get_bit(component, n + c))
+                        first[n - graph_degree(stp->red_black, n + c) + 1]++;
+        for (uint32_t d = 1; d <= n; d++)
+                first[d + 1] += first[d];
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (component == NULL || bitmap_get_bit(component, n + c))
+                        order[first[n - graph_degree(stp->red_black, n + c)]++] = c;
+
+        for (uint32_t s = 0; s < n; s++)
+                last[s] = NO_PARENT;
+        bool found = true;
+        for (uint32_t i = 0; i < k && found; i++) {
+                uint32_t c = order[i];
+                bool first_species = true;
+                for (uint32_t s = graph_next_neighbor(stp->red_black, n + c, 0); s < n && found;
+                     s = graph_next_neighbor(stp->red_black, n + c, s + 1)) {
+                        if (first_species)
+                                parent[c] = last[s];
+                        found = (parent[c] == last[s]);
+                        first_species = false;
+                        last[s] = c;
+                }
+        }
+        scratch_release(mark);
+        log_debug("gusfield_tree: %d characters, perfect phylogeny: %d", k, found);
+        return found ? k : UINT32_MAX;
+}
+
+/**
+   \brief writes at \c out the subtree of the character \c c, in the same
+   format as \c newick, and returns the end of the string written
+*/
+static char*
+newick_subtree(char* out, uint32_t c, const uint32_t* first_child, const uint32_t* next_sibling) {
+        if (first_child[c] == NO_PARENT)
+                return out + sprintf(out, ":C%04u+", c);
+        bool siblings = next_sibling[first_child[c]] != NO_PARENT;
+        out += sprintf(out, siblings ? "((" : "(");
+        for (uint32_t d = first_child[c]; d != NO_PARENT; d = next_sibling[d]) {
+                if (d != first_child[c])
+                        *(out++) = ',';
+                out = newick_subtree(out, d, first_child, next_sibling);
+        }
+        return out + sprintf(out, siblings ? "):C%04u+)" : ":C%04u+)", c);
+}
+
+char*
+perfect_phylogeny_newick(const state_s* stp) {
+        uint32_t m = stp->num_characters_orig;
+        arena_mark_s mark = scratch_mark();
+        uint32_t* order = xmalloc_scratch(m * sizeof(uint32_t));
+        uint32_t* parent = xmalloc_scratch(m * sizeof(uint32_t));
+        uint32_t k = gusfield_tree(stp, NULL, order, parent);
+        if (k == UINT32_MAX) {
+                scratch_release(mark);
+                return NULL;
+        }
+/*
+  The children of each character, and the roots (the children of the
+  character m), are listed in the order of order, since they are inserted
+  from the last one.
+*/
+        uint32_t* first_child = xmalloc_scratch((m + 1) * sizeof(uint32_t));
+        uint32_t* next_sibling = xmalloc_scratch((m + 1) * sizeof(uint32_t));
+        for (uint32_t c = 0; c <= m; c++)
+                first_child[c] = NO_PARENT;
+        for (uint32_t i = k; i > 0; i--) {
+                uint32_t c = order[i - 1];
+                uint32_t p = (parent[c] == NO_PARENT) ? m : parent[c];
+                next_sibling[c] = first_child[p];
+                first_child[p] = c;
+        }
+/*
+  Each character writes at most 18 bytes: its label of at most 13 bytes,
+  two parentheses and a comma, and two more parentheses if it has more
+  children.
+*/
+        char* result = xmalloc(18 * (k + 1) + 4);
+        char* out = result;
+        bool siblings = first_child[m] != NO_PARENT && next_sibling[first_child[m]] != NO_PARENT;
+        if (siblings || first_child[m] == NO_PARENT)
+                *(out++) = '(';
+        for (uint32_t c = first_child[m]; c != NO_PARENT; c = next_sibling[c]) {
+                if (c != first_child[m])
+                        *(out++) = ',';
+                out = newick_subtree(out, c, first_child, next_sibling);
+        }
+        if (siblings || first_child[m] == NO_PARENT)
+                *(out++) = ')';
+        strcpy(out, ";");
+        scratch_release(mark);
+        log_debug("perfect_phylogeny_newick: %s", result);
+        return result;
+}
+
+uint32_t
+perfect_phylogeny_root(const state_s* stp) {
+        uint32_t m = stp->num_characters_orig;
+        arena_mark_s mark = scratch_mark();
+        uint32_t* order = xmalloc_scratch(m * sizeof(uint32_t));
+        uint32_t* parent = xmalloc_scratch(m * sizeof(uint32_t));
+        uint32_t k = gusfield_tree(stp, stp->current_component, order, parent);
+        uint32_t root = (k != UINT32_MAX && k > 0) ? stp->character_representative[order[0]] : UINT32_MAX;
+        scratch_release(mark);
+        return root;
+}
+
+/**
+   \brief tests if the columns \c a and \c b intersect, while neither
+   includes the other
+*/
+static bool
+overlapping_columns(const bitmap_word* a, const bitmap_word* b, uint32_t nwords) {
+        bitmap_word g11 = 0, g10 = 0, g01 = 0;
+        for (uint32_t i = 0; i < nwords; i++) {
+                g11 |= a[i] & b[i];
+                g10 |= a[i] & ~b[i];
+                g01 |= ~a[i] & b[i];
+        }
+        return g11 != 0 && g10 != 0 && g01 != 0;
+}
+
+/**
+   The columns of the active characters are their red neighborhoods: a red
+   Σ-graph exists iff two active characters of the same connected component
+   have red neighborhoods that intersect, while neither includes the other.
+*/
+bool
+red_sigma_graph(const state_s* stp, const bitmap_word* component) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        uint32_t chars[m];
+        uint32_t k = 0;
+        for (uint32_t c = bitmap_next_set(stp->characters, m, 0); c < m; c = bitmap_next_set(stp->characters, m, c + 1))
+                if (stp->colors[c] == RED && (component == NULL || bitmap_get_bit(component, n + c)))
+                        chars[k++] = c;
+        if (k < 2)
+                return false;
+        uint32_t nwords = BITMAP_NWORDS(n);
+        arena_mark_s mark = scratch_mark();
+        bitmap_word* columns = species_columns(stp, chars, k, nwords);
+        bool found = false;
+        for (uint32_t i1 = 0; i1 < k && !found; i1++)
+                for (uint32_t i2 = i1 + 1; i2 < k && !found; i2++) {
+                        if (stp->connected_components[n + chars[i1]] != stp->connected_components[n + chars[i2]])
+                                continue;
+                        found = overlapping_columns(columns + i1 * nwords, columns + i2 * nwords, nwords);
+                        if (found)
+                                log_debug("red_sigma_graph: characters %d %d", chars[i1], chars[i2]);
+                }
+        scratch_release(mark);
+        return found;
+}
+
+bool
+red_sigma_graph_with(const state_s* stp, uint32_t c) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t m = stp->num_characters_orig;
+        if (!bitmap_get_bit(stp->characters, c) || stp->colors[c] != RED)
+                return false;
+        uint32_t label = stp->connected_components[n + c];
+        uint32_t chars[m];
+        uint32_t k = 0;
+        chars[k++] = c;
+        for (uint32_t d = bitmap_next_set(stp->characters, m, 0); d < m; d = bitmap_next_set(stp->characters, m, d + 1))
+                if (d != c && stp->colors[d] == RED && stp->connected_components[n + d] == label)
+                        chars[k++] = d;
+        if (k < 2)
+                return false;
+        uint32_t nwords = BITMAP_NWORDS(n);
+        arena_mark_s mark = scratch_mark();
+        bitmap_word* columns = species_columns(stp, chars, k, nwords);
+        bool found = false;
+        for (uint32_t i = 1; i < k && !found; i++) {
+                found = overlapping_columns(columns, columns + i * nwords, nwords);
+                if (found)
+                        log_debug("red_sigma_graph_with: characters %d %d", c, chars[i]);
+        }
+        scratch_release(mark);
+        return found;
+}
@@ -44,6 +44,8 @@
 #include <error.h>
 #include "graph.h"
 #include "memory.h"
+#include "reader.h"
+#include "binary_format.h"
 
 #define SPECIES 0
 #define BLACK 1
@@ -67,21 +69,59 @@
    Notice that the last character in \c tried_characters is equal to \c realized_char
 
    The \c matrix field can be \c NULL, if we are not interested in the matrix
-   any more.
+   any more. Otherwise it is the input matrix, stored as a bitmap of \c
+   BITMAP_NWORDS(num_characters_orig) words for each species, where a bit is
+   set iff the species has the character.
 
-   \c current_component contains the current connected component of
+   \c current_component is the bitmap of the current connected component of
    the red-black graph. It is used to solve separately each connected
    component by a careful managing of the backtracking
 
 
-   \c species and \c characters are two arrays whose values are 1 for the actual species and characters
+   \c connected_components contains the label of the connected component of
+   each vertex of the red-black graph. Labels are in the range 0 \c
+   num_components - 1, and \c component_size and \c component_species contain
+   respectively the number of vertices and of species of each component. They
+   are maintained incrementally by \c realize_character, since only the
+   component of the realized character can change.
+
+   Identical species are collapsed when the instance is read: only the
+   first species of each class is kept, and \c species_multiplicity
+   contains the number of species it represents. Since identical species
+   remain identical after each realization, the multiplicity does not
+   change, and it is counted in \c component_size, so that components are
+   compared as if all species were present. \c component_species counts
+   each species once.
+
+   \c character_representative contains, for each inactive character of \c
+   character_queue, the first character of the queue with the same species
+   in the red-black graph. Realizing two such characters leads to
+   isomorphic subtrees of the decision tree, therefore only the first one
+   is tried.
+
+   \c species and \c characters are two bitmaps whose bits are set for the actual species and characters
    respectively.
 
+   All arrays of a state, and the adjacency of its graphs if they are not
+   shared, are stored in the single block \c data, each aligned to a cache
+   line. The block starts with the \c graph_bytes bytes of the graphs (0 if
+   the graphs are shared), followed by the \c copied_bytes bytes of the
+   arrays that \c copy_state copies, so that copying a state is a single
+   \c memcpy. The other arrays (\c tried_characters, \c character_queue,
+   \c character_representative and \c species_multiplicity) and the
+   graphs themselves come next, and they are not copied.
+
    \c operation is the code for the most recent operation:
    0 => failure
    1 => realize an inactive character
    2 => realize an active character
 
+   When \c trail is not \c NULL, the graphs \c red_black and \c conflict are
+   shared by all states of the decision tree and each change of the graphs
+   is recorded in \c trail. \c trail_mark is the size of the trail when the
+   state has been reached, so that undoing the trail up to \c trail_mark
+   restores the graphs of the state.
+
    the \c color of each character encodes if it is active or not.
    The possible values are:
    BLACK => the character is inactive
@@ -90,9 +130,12 @@
 typedef struct state_s {
         graph_s *red_black;
         graph_s *conflict;
-        bool *species;
-        bool *characters;
+        bitmap_word *species;
+        bitmap_word *characters;
         uint32_t *connected_components;
+        uint32_t *component_size;
+        uint32_t *component_species;
+        uint32_t num_components;
         uint32_t num_species;
         uint32_t num_characters;
         uint32_t num_species_orig;
@@ -102,11 +145,18 @@ typedef struct state_s {
         uint32_t *character_queue;
         uint32_t tried_characters_size;
         uint32_t character_queue_size;
-        bool *current_component;
-        uint32_t *matrix;
+        bitmap_word *current_component;
+        bitmap_word *matrix;
+        uint32_t *species_multiplicity;
+        uint32_t *character_representative;
         uint32_t operation;
         uint32_t realize;
         uint32_t backtrack_level;
+        graph_trail_s *trail;
+        size_t trail_mark;
+        void *data;
+        size_t graph_bytes;
+        size_t copied_bytes;
 } state_s;
 
 /**
@@ -124,13 +174,62 @@ typedef struct array_s {
    memory that is required and gives the correct values to
    \c num_species_orig and \c num_characters_orig
 
+   \c init_shared_state is the same as \c init_state, but the new state
+   shares the graphs of \c shared, instead of allocating its own. The
+   changes to the shared graphs are recorded in an undo trail, which is
+   created the first time the graphs of \c shared are shared.
+
    \c resize_state sets the values of \c num_species and \c num_characters
 */
 void init_state(state_s *stp, uint32_t nspecies, uint32_t nchars);
 
+void init_shared_state(state_s *stp, state_s *shared);
+
 void
 resize_state(state_s *stp, uint32_t nspecies, uint32_t nchars);
 
+/**
+   \brief sets the representation (\c GRAPH_DENSE or \c GRAPH_BITMAP) of the
+   red-black and of the conflict graph of all states initialized afterwards
+
+   Since the red-black graph is bipartite (species on a side, characters on the
+   other), it can also be stored as a \c GRAPH_BIPARTITE graph, where only the
+   \f$n\cdot m\f$ biadjacency matrix is stored.
+*/
+void
+set_graph_representations(uint32_t red_black, uint32_t conflict);
+
+#define PHASE_CONNECTED_COMPONENTS      0
+#define PHASE_CONFLICT_GRAPH            1
+#define PHASE_CLEANUP                   2
+#define NUM_PHASES                      3
+
+/**
+   \brief enables or disables (the default) the measure of the time spent in
+   each phase of the update of a state: the connected components
+   (\c update_connected_components and \c update_component), the conflict
+   graph (\c update_conflict_graph and \c update_conflict_graph_component)
+   and \c cleanup.
+
+   When disabled, the clock is never read.
+*/
+void
+set_phase_timing(bool enabled);
+
+/**
+   \brief stores in \c seconds the time spent by the calling thread in each
+   phase, since the start of the thread. The time spent in a portion of code
+   is the difference of two calls.
+*/
+void
+phase_times(double *seconds);
+
+/**
+   \return the time in seconds of a monotonic clock
+*/
+double
+monotonic_seconds(void);
+
 /**
    \brief check if a state is internally consistent
 
@@ -161,6 +260,7 @@ void cleanup(state_s *src);
    \brief copy a state
 
    The \c characters_queue and the \c tried_characters are not copied.
+   The graphs are not copied when they are shared by the two states.
    To copy also those fields, use the \c full_copy_state function.
    The destination must have already been allocated
 
@@ -204,9 +304,19 @@ void delete_character(state_s* stp, uint32_t c);
 
 /**
    \struct data common to all instances in a file
+
+   The file starts with the number of species and of characters, followed
+   by the matrices, each with a line for each species. \c reader is \c NULL
+   until the file is opened.
+
+   If the file is in the binary format (see binary_format.h), \c binary is its
+   header and \c next_instance is the index of the next instance to read,
+   otherwise \c binary is \c NULL.
 */
 typedef struct instances_schema_s {
-        FILE* file;
+        reader_s* reader;
+        const binary_header_s* binary;
+        uint64_t next_instance;
         char* filename;
         uint32_t num_species;
         uint32_t num_characters;
@@ -230,6 +340,22 @@ typedef struct instances_schema_s {
 bool
 read_instance_from_filename(instances_schema_s* global_props, state_s* stp);
 
+/**
+   \brief read another instance from file, if possible, storing in \c cells
+   the value of each cell (in row-major order), without computing the
+   corresponding state. Returns \c true if the instance has been read
+   correctly.
+*/
+bool
+read_instance_cells(instances_schema_s* global_props, uint8_t* cells);
+
+/**
+   \brief writes all instances of the file in \c out, in the binary format if
+   \c binary is \c true, and in the text format otherwise.
+*/
+void
+convert_instances(instances_schema_s* global_props, FILE* out, bool binary);
+
 /**
    \param character: the source state \c src and the outcome \c dst of
    the realization. The character to realize is \c src->realize
@@ -241,12 +367,23 @@ bool realize_character(state_s* dst, state_s* src);
 
 /**
    \brief updates the connected components of the red-black graph of
-   the current state
+   the current state, recomputing them from scratch
 */
 
 void
 update_connected_components(state_s* stp);
 
+/**
+   \brief updates the connected components of the red-black graph of
+   the current state, when only the edges of the connected component \c
+   component have changed.
+
+   \param component: the bitmap of the vertices of the component, as
+   stored in \c current_component
+*/
+void
+update_component(state_s* stp, const bitmap_word* component);
+
 
 /**
    \param inst: state_s
@@ -283,10 +420,26 @@ smallest_component(state_s* stp);
 
 /**
    \brief update the conflict graph
+
+   Two characters are adjacent in the conflict graph iff they belong to the
+   same connected component of the red-black graph and the species of the
+   component induce the four gametes on the two characters.
+
+   It requires that the connected_component field has been previously updated.
 */
 void
 update_conflict_graph(state_s* stp);
 
+/**
+   \brief update the conflict graph after that the connected component \c
+   component of the red-black graph has changed.
+
+   Only the pairs of characters of \c component are tested again. When
+   compiled with \c DEBUG, the result is compared with a full rebuild.
+*/
+void
+update_conflict_graph_component(state_s* stp, const bitmap_word* component);
+
 /**
    \brief analyzes the array of states and computes the resulting tree
    in Newick format
@@ -295,3 +448,51 @@ update_conflict_graph(state_s* stp);
 */
 char*
 newick(state_s* states);
+
+/**
+   \brief computes the phylogeny of an instance without conflicts and without
+   active characters with Gusfield's algorithm, in time linear in the size
+   of the matrix. The phylogeny has no losses.
+
+   \return the tree in the format of \c newick, or \c NULL if the instance
+   has no perfect phylogeny (even if the conflict graph has no edges, the
+   species of a component might induce only three gametes on two characters)
+*/
+char*
+perfect_phylogeny_newick(const state_s* stp);
+
+/**
+   \brief tests if the current component has only inactive characters and a
+   perfect phylogeny: in that case the character with the most species is
+   adjacent to all species of the component, and realizing the characters in
+   the order of Gusfield's algorithm solves the component without
+   backtracking.
+
+   \return the character with the most species (the first of its duplicates),
+   or \c UINT32_MAX if the component has no perfect phylogeny
+*/
+uint32_t
+perfect_phylogeny_root(const state_s* stp);
+
+/**
+   \brief tests if the red-black graph has a red Σ-graph among the active
+   characters of \c component (of all components, if \c component is \c
+   NULL): two active characters \c c1 and \c c2 and three species \c s1, \c
+   s2, \c s3 such that \c s1 - \c c1 - \c s2 - \c c2 - \c s3 is an induced
+   path of red edges. A red-black graph with a red Σ-graph has no successful
+   reduction.
+*/
+bool
+red_sigma_graph(const state_s* stp, const bitmap_word* component);
+
+/**
+   \brief tests if the active character \c c belongs to a red Σ-graph, with
+   another active character of its connected component.
+
+   Since the realization of a character changes only its own edges, a
+   realization creates a red Σ-graph only if the realized character belongs
+   to it: this test is enough after each realization of a search that
+   starts from a red-black graph without red Σ-graphs.
+*/
+bool
+red_sigma_graph_with(const state_s* stp, uint32_t c);
@@ -0,0 +1,196 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file reader.c
+   @brief Implementation of @c reader.h
+
+*/
+#include "reader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+reader_s*
+reader_open(const char* filename) {
+        log_debug("reader_open: %s", filename);
+        reader_s* rp = xmalloc(sizeof(reader_s));
+        rp->filename = filename;
+        rp->fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : STDIN_FILENO;
+        if (rp->fd < 0)
+                error(3, errno, "Could not open input file: %s\n", filename);
+        rp->mapped = false;
+        rp->data = NULL;
+        rp->size = 0;
+        rp->pos = 0;
+        rp->offset = 0;
+        rp->line = 1;
+        rp->line_start = 0;
+
+        struct stat st;
+        if (fstat(rp->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, rp->fd, 0);
+                if (p != MAP_FAILED) {
+                        madvise(p, st.st_size, MADV_SEQUENTIAL);
+                        rp->data = p;
+                        rp->size = st.st_size;
+                        rp->mapped = true;
+                }
+        }
+        if (!rp->mapped)
+                rp->data = xmalloc_atomic(READER_BUFFER_SIZE);
+        log_debug("reader_open: mapped=%d", rp->mapped);
+        return rp;
+}
+
+void
+reader_close(reader_s* rp) {
+        log_debug("reader_close: %s", rp->filename);
+        if (rp->mapped)
+                munmap(rp->data, rp->size);
+        if (rp->fd > STDIN_FILENO)
+                close(rp->fd);
+        rp->fd = -1;
+        rp->mapped = false;
+        rp->offset += rp->size;
+        rp->size = 0;
+        rp->pos = 0;
+}
+
+/**
+   \brief reads the next block of a file that is not mapped.
+
+   \return \c false iff the end of the file has been reached
+*/
+static bool
+reader_fill(reader_s* rp) {
+        if (rp->mapped || rp->fd < 0)
+                return false;
+        rp->offset += rp->size;
+        rp->pos = 0;
+        ssize_t n;
+        do {
+                n = read(rp->fd, rp->data, READER_BUFFER_SIZE);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+                error(3, errno, "Could not read input file: %s\n", rp->filename);
+        rp->size = n;
+        return (n > 0);
+}
+
+/**
+   \brief returns the current byte, or \c EOF at the end of the file
+*/
+static inline int
+reader_peek(reader_s* rp) {
+        if (rp->pos == rp->size && !reader_fill(rp))
+                return EOF;
+        return (unsigned char) rp->data[rp->pos];
+}
+
+/**
+   \brief moves to the next byte, which must be available
+*/
+static inline void
+reader_advance(reader_s* rp) {
+        assert(rp->pos < rp->size);
+        if (rp->data[rp->pos] == '\n') {
+                rp->line++;
+                rp->line_start = rp->offset + rp->pos + 1;
+        }
+        rp->pos++;
+}
+
+static inline bool
+is_space(int ch) {
+        return (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\v' || ch == '\f');
+}
+
+bool
+reader_next_token(reader_s* rp) {
+        int ch;
+        while ((ch = reader_peek(rp)) != EOF && is_space(ch))
+                reader_advance(rp);
+        return (ch != EOF);
+}
+
+bool
+reader_end_of_line(reader_s* rp) {
+        int ch;
+        while ((ch = reader_peek(rp)) != EOF && ch != '\n' && is_space(ch))
+                reader_advance(rp);
+        return (ch == EOF || ch == '\n');
+}
+
+bool
+reader_end_of_file(reader_s* rp) {
+        return (reader_peek(rp) == EOF);
+}
+
+/**
+   \brief checks that the token that has just been read is followed by
+   whitespace or by the end of the file
+*/
+static void
+reader_end_of_token(reader_s* rp) {
+        int ch = reader_peek(rp);
+        if (ch != EOF && !is_space(ch))
+                reader_error(rp, "unexpected character '%c'", ch);
+}
+
+uint32_t
+reader_read_uint(reader_s* rp) {
+        int ch = reader_peek(rp);
+        if (ch < '0' || ch > '9')
+                reader_error(rp, "expected a number");
+        uint64_t x = 0;
+        for (; ch >= '0' && ch <= '9'; ch = reader_peek(rp)) {
+                x = 10 * x + (ch - '0');
+                if (x > UINT32_MAX)
+                        reader_error(rp, "number too large");
+                reader_advance(rp);
+        }
+        reader_end_of_token(rp);
+        return (uint32_t) x;
+}
+
+uint8_t
+reader_read_cell(reader_s* rp) {
+        int ch = reader_peek(rp);
+        if (ch < '0' || ch > '2')
+                reader_error(rp, "expected 0, 1 or 2");
+        reader_advance(rp);
+        reader_end_of_token(rp);
+        return (uint8_t) (ch - '0');
+}
+
+void
+reader_error(const reader_s* rp, const char* format, ...) {
+        char message[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        size_t column = rp->offset + rp->pos - rp->line_start + 1;
+        error_at_line(2, 0, rp->filename, rp->line, "Badly formatted input file, column %zu: %s", column, message);
+}
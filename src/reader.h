@@ -0,0 +1,129 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file reader.h
+   @brief Reading the text files containing the matrices.
+
+   A regular file is mapped in memory, while other files (such as pipes and
+   the standard input, whose name is \c -) are read in blocks of \c
+   READER_BUFFER_SIZE bytes. In both cases, the input is scanned one byte at
+   a time, keeping track of the current line and column, so that malformed
+   input can be reported precisely.
+*/
+#ifndef CPPP_READER_H
+#define CPPP_READER_H
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+#include <error.h>
+#include "logging.h"
+#include "memory.h"
+
+#define READER_BUFFER_SIZE (1 << 16)
+
+/**
+   \struct reader_s
+   \brief an input file that is being read
+
+   \c data contains the \c size bytes available, that is the whole file if
+   \c mapped, or the last block read otherwise. \c pos is the position of
+   the next byte in \c data, and \c offset is the position in the file of
+   the first byte of \c data.
+
+   \c line is the current line (starting from 1) and \c line_start is the
+   position in the file of its first byte.
+*/
+typedef struct reader_s {
+        const char *filename;
+        int fd;
+        bool mapped;
+        char *data;
+        size_t size;
+        size_t pos;
+        size_t offset;
+        uint32_t line;
+        size_t line_start;
+} reader_s;
+
+/**
+   \brief managing readers:
+   \c reader_open opens a file (or the standard input if \c filename is \c -)
+   and terminates the program if this is not possible.
+
+   \c reader_close closes the file.
+*/
+reader_s*
+reader_open(const char* filename);
+
+void
+reader_close(reader_s* rp);
+
+/**
+   \brief skips all whitespace, including newlines.
+
+   \return \c false iff the end of the file has been reached
+*/
+bool
+reader_next_token(reader_s* rp);
+
+/**
+   \brief skips spaces and tabs, but not newlines.
+
+   \return \c true iff the current line has ended
+*/
+bool
+reader_end_of_line(reader_s* rp);
+
+/**
+   \brief \return \c true iff the end of the file has been reached
+*/
+bool
+reader_end_of_file(reader_s* rp);
+
+/**
+   \brief reads an unsigned integer, which must begin at the current
+   position
+*/
+uint32_t
+reader_read_uint(reader_s* rp);
+
+/**
+   \brief reads a cell of a matrix, that is a single digit \c 0, \c 1 or \c
+   2, which must begin at the current position
+*/
+uint8_t
+reader_read_cell(reader_s* rp);
+
+/**
+   \brief terminates the program reporting that the input is malformed at
+   the current line and column. The remaining arguments are a printf-like
+   description of the error.
+*/
+void
+reader_error(const reader_s* rp, const char* format, ...);
+
+#endif
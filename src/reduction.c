@@ -0,0 +1,184 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+#include "decision_tree.h"
+#include "reduction.h"
+
+/**
+   \struct candidate_s
+   \brief an inactive character and its priority: characters with smaller
+   scores are considered first
+*/
+typedef struct candidate_s {
+        uint64_t score;
+        uint32_t character;
+        uint32_t position;
+} candidate_s;
+
+static int
+smaller_score_first(const void* a, const void* b) {
+        const candidate_s* c1 = a;
+        const candidate_s* c2 = b;
+        if (c1->score != c2->score)
+                return (c1->score < c2->score) ? -1 : 1;
+        return (c1->position > c2->position) - (c1->position < c2->position);
+}
+
+/**
+   \brief stores in \c chars the inactive characters of the queue of \c stp
+   that are the first of their duplicates, in the order in which they are
+   considered, and returns their number.
+
+   A character is maximal if its species are not a proper subset of the
+   species of another inactive character of the component.
+*/
+static uint32_t
+candidate_characters(const state_s *stp, uint32_t *chars) {
+        uint32_t n = stp->num_species_orig;
+        uint32_t nwords = BITMAP_NWORDS(n);
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < stp->character_queue_size; i++) {
+                uint32_t c = stp->character_queue[i];
+                if (stp->colors[c] == BLACK && stp->character_representative[c] == c)
+                        chars[k++] = c;
+        }
+        arena_mark_s mark = scratch_mark();
+        bitmap_word* columns = xmalloc_scratch(k * nwords * sizeof(bitmap_word));
+        candidate_s* candidates = xmalloc_scratch(k * sizeof(candidate_s));
+        for (uint32_t i = 0; i < k; i++)
+                for (uint32_t s = graph_next_neighbor(stp->red_black, n + chars[i], 0); s < n;
+                     s = graph_next_neighbor(stp->red_black, n + chars[i], s + 1))
+                        bitmap_set_bit(columns + i * nwords, s);
+        for (uint32_t i = 0; i < k; i++) {
+                uint32_t degree = graph_degree(stp->red_black, n + chars[i]);
+                bool maximal = true;
+                for (uint32_t j = 0; j < k && maximal; j++)
+                        maximal = !(graph_degree(stp->red_black, n + chars[j]) > degree &&
+                                    bitmap_includes(columns + i * nwords, columns + j * nwords, n));
+                candidates[i] = (candidate_s) {
+                        .score = (maximal ? 0 : (uint64_t) 1 << 32) + UINT32_MAX - degree,
+                        .character = chars[i],
+                        .position = i
+                };
+        }
+        qsort(candidates, k, sizeof(candidate_s), smaller_score_first);
+        for (uint32_t i = 0; i < k; i++)
+                chars[i] = candidates[i].character;
+        scratch_release(mark);
+        return k;
+}
+
+/**
+   \brief the number of levels below a candidate that are examined before
+   choosing it
+*/
+#define REDUCTION_LOOKAHEAD 1
+
+/**
+   \brief the character to realize at the state \c stp, whose current
+   component has been computed, or \c UINT32_MAX if there is none.
+
+   A candidate is chosen if its realization succeeds, it does not create a
+   red Σ-graph, and, if \c depth is positive, the resulting state has a
+   character to realize according to \c choose_character with depth \c
+   depth - 1. Each candidate is realized in a scratch state, allocated in
+   the scratch arena, as in the lookahead strategy.
+*/
+static uint32_t
+choose_character(state_s *stp, uint32_t depth, search_stats_s *stats) {
+        if (stp->character_queue_size == 0)
+                return UINT32_MAX;
+        if (stp->colors[stp->character_queue[0]] != BLACK)
+                return stp->character_queue[0];
+        uint32_t root = perfect_phylogeny_root(stp);
+        if (root != UINT32_MAX) {
+                stats->perfect_phylogeny_nodes++;
+                return root;
+        }
+        uint32_t chars[stp->character_queue_size];
+        uint32_t k = candidate_characters(stp, chars);
+        uint32_t chosen = UINT32_MAX;
+        uint32_t realize = stp->realize;
+        arena_mark_s mark = scratch_mark();
+        arena_s* arena = arena_use(scratch_arena());
+        state_s scratch;
+        init_state(&scratch, stp->num_species_orig, stp->num_characters_orig);
+        for (uint32_t i = 0; i < k && chosen == UINT32_MAX; i++) {
+                stp->realize = chars[i];
+                if (!realize_character(&scratch, stp)) {
+                        stats->failed_black++;
+                        continue;
+                }
+                if (red_sigma_graph(&scratch, stp->current_component)) {
+                        log_debug("choose_character: %d creates a red sigma-graph", chars[i]);
+                        continue;
+                }
+                if (depth > 0 && scratch.num_species > 0) {
+                        smallest_component(&scratch);
+                        if (choose_character(&scratch, depth - 1, stats) == UINT32_MAX) {
+                                log_debug("choose_character: %d leads to a dead end", chars[i]);
+                                continue;
+                        }
+                }
+                chosen = chars[i];
+        }
+        arena_use(arena);
+        scratch_release(mark);
+        stp->realize = realize;
+        return chosen;
+}
+
+uint32_t
+reduction_search(state_s *states, uint32_t max_depth, search_stats_s *stats) {
+        double start = monotonic_seconds();
+        search_stats_s local = { .outcome = SEARCH_UNKNOWN };
+        uint32_t n = states[0].num_species_orig;
+        uint32_t m = states[0].num_characters_orig;
+        for (uint32_t level = 0; level < max_depth; level++) {
+                state_s *stp = states + level;
+                if (stp->num_species == 0) {
+                        local.outcome = SEARCH_FOUND;
+                        break;
+                }
+                local.nodes++;
+                local.max_depth = level;
+                smallest_component(stp);
+                uint32_t c = choose_character(stp, REDUCTION_LOOKAHEAD, &local);
+                if (c == UINT32_MAX) {
+                        log_debug("reduction_search: no character to realize at level %d", level);
+                        break;
+                }
+                if (states[level + 1].red_black == NULL)
+                        init_state(states + level + 1, n, m);
+                stp->realize = c;
+                bool black = (stp->colors[c] == BLACK);
+                if (!realize_character(states + level + 1, stp)) {
+                        black ? local.failed_black++ : local.failed_red++;
+                        break;
+                }
+                black ? local.realized_black++ : local.realized_red++;
+        }
+        local.steps = local.nodes;
+        local.seconds = monotonic_seconds() - start;
+        log_debug("reduction_search: outcome %d after %" PRIu64 " levels", local.outcome, local.nodes);
+        if (stats != NULL)
+                *stats = local;
+        return local.outcome;
+}
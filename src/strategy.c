@@ -0,0 +1,191 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+#include "perfect_phylogeny.h"
+#include "strategy.h"
+
+/**
+   \struct scored_character_s
+   \brief a character, its score and its position in the queue: characters
+   with smaller scores are tried first
+*/
+typedef struct scored_character_s {
+        uint64_t score;
+        uint32_t character;
+        uint32_t position;
+} scored_character_s;
+
+static int
+smaller_score_first(const void* a, const void* b) {
+        const scored_character_s* c1 = a;
+        const scored_character_s* c2 = b;
+        if (c1->score != c2->score)
+                return (c1->score < c2->score) ? -1 : 1;
+        return (c1->position > c2->position) - (c1->position < c2->position);
+}
+
+/**
+   \brief sorts \c chars by increasing \c scores, keeping their order in
+   case of ties
+*/
+static void
+sort_by_score(uint32_t *chars, const uint64_t *scores, uint32_t num_chars) {
+        arena_mark_s mark = scratch_mark();
+        scored_character_s* scored = xmalloc_scratch(num_chars * sizeof(scored_character_s));
+        for (uint32_t i = 0; i < num_chars; i++)
+                scored[i] = (scored_character_s) { .score = scores[i], .character = chars[i], .position = i };
+        qsort(scored, num_chars, sizeof(scored_character_s), smaller_score_first);
+        for (uint32_t i = 0; i < num_chars; i++)
+                chars[i] = scored[i].character;
+        scratch_release(mark);
+}
+
+/**
+   \c smallest_component already lists the characters in the input order, and
+   they are not reordered
+*/
+static void
+input_order(state_s *stp, uint32_t *chars, uint32_t num_chars) {
+}
+
+static void
+red_black_degree(state_s *stp, uint32_t *chars, uint32_t num_chars) {
+        if (num_chars < 2)
+                return;
+        uint64_t scores[num_chars];
+        for (uint32_t i = 0; i < num_chars; i++)
+                scores[i] = UINT32_MAX - graph_degree(stp->red_black, stp->num_species_orig + chars[i]);
+        sort_by_score(chars, scores, num_chars);
+}
+
+static void
+conflict_degree(state_s *stp, uint32_t *chars, uint32_t num_chars) {
+        if (num_chars < 2)
+                return;
+        uint64_t scores[num_chars];
+        for (uint32_t i = 0; i < num_chars; i++)
+                scores[i] = UINT32_MAX - graph_degree(stp->conflict, chars[i]);
+        sort_by_score(chars, scores, num_chars);
+}
+
+/**
+   Realizing the inactive character \c c connects it to the species of the
+   current component that do not have \c c, while the species that have \c c
+   are disconnected from \c c. Therefore the component of \c c after the
+   realization consists of the vertices that are reachable from the species
+   without \c c, avoiding \c c itself. Each species is counted with its
+   multiplicity.
+*/
+static void
+fail_first(state_s *stp, uint32_t *chars, uint32_t num_chars) {
+        if (num_chars < 2)
+                return;
+        uint32_t n = stp->num_species_orig;
+        uint32_t num_vertices = stp->red_black->num_vertices;
+        arena_mark_s mark = scratch_mark();
+        bool* reached = xmalloc_scratch(num_vertices * sizeof(bool));
+        uint32_t* queue = xmalloc_scratch(num_vertices * sizeof(uint32_t));
+        uint64_t scores[num_chars];
+        for (uint32_t i = 0; i < num_chars; i++) {
+                uint32_t c = n + chars[i];
+                memset(reached, 0, num_vertices * sizeof(bool));
+                reached[c] = true;
+                uint32_t size = 0;
+                for (uint32_t s = bitmap_next_set(stp->current_component, n, 0); s < n; s = bitmap_next_set(stp->current_component, n, s + 1))
+                        if (!graph_get_edge(stp->red_black, s, c)) {
+                                reached[s] = true;
+                                queue[size++] = s;
+                        }
+                scores[i] = 0;
+                for (uint32_t head = 0; head < size; head++) {
+                        uint32_t v = queue[head];
+                        if (v < n)
+                                scores[i] += stp->species_multiplicity[v];
+                        for (uint32_t w = graph_next_neighbor(stp->red_black, v, 0); w < num_vertices;
+                             w = graph_next_neighbor(stp->red_black, v, w + 1))
+                                if (!reached[w]) {
+                                        reached[w] = true;
+                                        queue[size++] = w;
+                                }
+                }
+        }
+        scratch_release(mark);
+        sort_by_score(chars, scores, num_chars);
+}
+
+/**
+   Each character is realized in a scratch state, which has its own graphs,
+   so that the graphs of \c stp are not changed even when they are shared.
+   The scratch state is allocated in the scratch arena.
+*/
+static void
+lookahead(state_s *stp, uint32_t *chars, uint32_t num_chars) {
+        if (num_chars < 2)
+                return;
+        arena_mark_s mark = scratch_mark();
+        arena_s* arena = arena_use(scratch_arena());
+        state_s scratch;
+        init_state(&scratch, stp->num_species_orig, stp->num_characters_orig);
+        uint32_t realize = stp->realize;
+        uint32_t operation = stp->operation;
+        uint64_t scores[num_chars];
+        for (uint32_t i = 0; i < num_chars; i++) {
+                stp->realize = chars[i];
+                if (!realize_character(&scratch, stp)) {
+                        scores[i] = UINT64_MAX;
+                        continue;
+                }
+                scores[i] = 0;
+                for (uint32_t c = 0; c < scratch.num_characters_orig; c++)
+                        if (bitmap_get_bit(scratch.characters, c) && graph_degree(scratch.conflict, c) > 0)
+                                scores[i]++;
+        }
+        arena_use(arena);
+        scratch_release(mark);
+        stp->realize = realize;
+        stp->operation = operation;
+        sort_by_score(chars, scores, num_chars);
+}
+
+static const strategy_fn strategies[NUM_STRATEGIES] = {
+        [STRATEGY_INPUT] = input_order,
+        [STRATEGY_RED_BLACK_DEGREE] = red_black_degree,
+        [STRATEGY_CONFLICT_DEGREE] = conflict_degree,
+        [STRATEGY_FAIL_FIRST] = fail_first,
+        [STRATEGY_LOOKAHEAD] = lookahead
+};
+
+static const char* strategy_names[NUM_STRATEGIES] = {
+        [STRATEGY_INPUT] = "input",
+        [STRATEGY_RED_BLACK_DEGREE] = "red-black-degree",
+        [STRATEGY_CONFLICT_DEGREE] = "conflict-degree",
+        [STRATEGY_FAIL_FIRST] = "fail-first",
+        [STRATEGY_LOOKAHEAD] = "lookahead"
+};
+
+strategy_fn
+get_strategy(uint32_t id) {
+        return (id < NUM_STRATEGIES) ? strategies[id] : NULL;
+}
+
+const char*
+strategy_name(uint32_t id) {
+        return (id < NUM_STRATEGIES) ? strategy_names[id] : "unknown";
+}
@@ -0,0 +1,87 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file strategy.h
+   @brief The orders in which the characters are tried at each node of the
+   decision tree.
+
+   When a node is created, \c smallest_component computes the characters of
+   the current component that can be realized. An active character that can
+   be freed is always tried first, while the order of the inactive
+   characters is decided by the strategy. Ties are broken in favor of the
+   character that comes first in the queue, that is the character with the
+   smallest index, unless the queue has been shuffled to break ties at
+   random.
+
+   The strategies are identified by the values of the \c --strategy option.
+*/
+#ifndef CPPP_STRATEGY_H
+#define CPPP_STRATEGY_H
+#include <stdint.h>
+
+struct state_s;
+
+/**
+   The strategy is a function that takes as a parameter a pointer to a new
+   state \c stp and reorders the \c num_chars inactive characters \c chars of
+   its \c character_queue.
+
+   In other words, it computes in which order we try to realize the characters
+   at the current node of the decision tree. It is called once for each node,
+   even if there are fewer than two characters to order.
+*/
+typedef void (*strategy_fn)(struct state_s *stp, uint32_t *chars, uint32_t num_chars);
+
+/**
+   \c STRATEGY_INPUT: same order as the input
+
+   \c STRATEGY_RED_BLACK_DEGREE: largest degree in the red-black graph first,
+   that is the characters shared by most species
+
+   \c STRATEGY_CONFLICT_DEGREE: largest degree in the conflict graph first
+
+   \c STRATEGY_FAIL_FIRST: first the characters whose realization leaves the
+   smallest number of species in the connected component of the character
+
+   \c STRATEGY_LOOKAHEAD: each character is realized, and the characters are
+   sorted by the number of characters still in conflict afterwards. The
+   characters whose realization is impossible are the last.
+*/
+#define STRATEGY_INPUT                  0
+#define STRATEGY_RED_BLACK_DEGREE       1
+#define STRATEGY_CONFLICT_DEGREE        2
+#define STRATEGY_FAIL_FIRST             3
+#define STRATEGY_LOOKAHEAD              4
+#define NUM_STRATEGIES                  5
+
+/**
+   \return the strategy with id \c id, or \c NULL if there is no such strategy
+*/
+strategy_fn
+get_strategy(uint32_t id);
+
+/**
+   \return a short name of the strategy with id \c id
+*/
+const char*
+strategy_name(uint32_t id);
+#endif
@@ -0,0 +1,163 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+#include "perfect_phylogeny.h"
+#include "trace.h"
+
+/**
+   \struct trace_buffer_s
+   \brief the ring buffer of a thread. \c num_events is the number of events
+   recorded, therefore the next event is stored in the position \c
+   num_events modulo \c TRACE_BUFFER_EVENTS.
+*/
+typedef struct trace_buffer_s {
+        trace_event_s *events;
+        uint64_t num_events;
+        uint32_t thread;
+} trace_buffer_s;
+
+static struct {
+        bool enabled;
+        uint32_t max_depth;
+        uint32_t every;
+        double start;
+        trace_buffer_s **buffers;
+        uint32_t num_buffers;
+        uint32_t capacity;
+} trace;
+
+static _Thread_local trace_buffer_s *local_buffer = NULL;
+
+void
+trace_start(uint32_t max_depth, uint32_t every) {
+        trace.enabled = true;
+        trace.max_depth = max_depth;
+        trace.every = (every > 0) ? every : 1;
+        trace.start = monotonic_seconds();
+}
+
+bool
+trace_enabled(void) {
+        return trace.enabled;
+}
+
+bool
+trace_sampled(uint32_t level, uint64_t step) {
+        if (!trace.enabled)
+                return false;
+        if (trace.max_depth > 0 && level > trace.max_depth)
+                return false;
+        return step % trace.every == 0;
+}
+
+/**
+   \brief the buffer of the calling thread, which is allocated and
+   registered at the first event of the thread. It is not allocated in the
+   arena of the thread, since it must survive the instance.
+*/
+static trace_buffer_s*
+thread_buffer(void) {
+        if (local_buffer != NULL)
+                return local_buffer;
+        arena_s *arena = arena_use(NULL);
+        trace_buffer_s *buffer = xmalloc(sizeof(trace_buffer_s));
+        buffer->events = xmalloc_atomic(TRACE_BUFFER_EVENTS * sizeof(trace_event_s));
+        buffer->num_events = 0;
+#pragma omp critical (trace_buffers)
+        {
+                if (trace.num_buffers == trace.capacity) {
+                        trace.capacity = 2 * trace.capacity + 8;
+                        trace.buffers = xrealloc(trace.buffers, trace.capacity * sizeof(trace_buffer_s*));
+                }
+                buffer->thread = trace.num_buffers;
+                trace.buffers[trace.num_buffers++] = buffer;
+        }
+        arena_use(arena);
+        local_buffer = buffer;
+        return buffer;
+}
+
+void
+trace_event(uint32_t kind, double start, double duration, int64_t arg0, int64_t arg1, int64_t arg2, int64_t arg3) {
+        trace_buffer_s *buffer = thread_buffer();
+        buffer->events[buffer->num_events % TRACE_BUFFER_EVENTS] = (trace_event_s) {
+                .start = start,
+                .duration = duration,
+                .kind = kind,
+                .args = { arg0, arg1, arg2, arg3 }
+        };
+        buffer->num_events++;
+}
+
+static void
+write_event(FILE *out, const trace_event_s *e, uint32_t thread) {
+        static const char* names[] = {
+                [TRACE_SEARCH] = "search",
+                [TRACE_NEXT_NODE] = "next_node",
+                [TRACE_REALIZE] = "realize",
+                [TRACE_BACKTRACK] = "backtrack",
+                [TRACE_COMPONENT] = "component"
+        };
+        fprintf(out, "{\"name\": \"%s\", \"cat\": \"search\", \"pid\": 1, \"tid\": %" PRIu32 ", \"ts\": %.3f, ",
+                names[e->kind], thread, (e->start - trace.start) * 1e6);
+        if (e->duration >= 0)
+                fprintf(out, "\"ph\": \"X\", \"dur\": %.3f, ", e->duration * 1e6);
+        else
+                fprintf(out, "\"ph\": \"i\", \"s\": \"t\", ");
+        switch (e->kind) {
+        case TRACE_SEARCH:
+                fprintf(out, "\"args\": {\"outcome\": %" PRId64 ", \"nodes\": %" PRId64 "}}", e->args[0], e->args[1]);
+                break;
+        case TRACE_NEXT_NODE:
+                fprintf(out, "\"args\": {\"level\": %" PRId64 "}}", e->args[0]);
+                break;
+        case TRACE_REALIZE:
+                fprintf(out, "\"args\": {\"level\": %" PRId64 ", \"character\": %" PRId64 ", \"color\": \"%s\", \"success\": %s}}",
+                        e->args[0], e->args[1], e->args[2] ? "black" : "red", e->args[3] ? "true" : "false");
+                break;
+        case TRACE_BACKTRACK:
+                fprintf(out, "\"args\": {\"from\": %" PRId64 ", \"to\": %" PRId64 "}}", e->args[0], e->args[1]);
+                break;
+        case TRACE_COMPONENT:
+                fprintf(out, "\"args\": {\"level\": %" PRId64 ", \"root\": %" PRId64 "}}", e->args[0], e->args[1]);
+                break;
+        }
+}
+
+void
+trace_write(FILE *out) {
+        fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"cppp\"}}");
+        for (uint32_t i = 0; i < trace.num_buffers; i++) {
+                trace_buffer_s *buffer = trace.buffers[i];
+                fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %" PRIu32 ", \"args\": {\"name\": \"thread %" PRIu32 "\"}}",
+                        buffer->thread, buffer->thread);
+                uint64_t first = 0;
+                if (buffer->num_events > TRACE_BUFFER_EVENTS) {
+                        first = buffer->num_events - TRACE_BUFFER_EVENTS;
+                        log_info("trace: thread %" PRIu32 " has overwritten its %" PRIu64 " oldest events", buffer->thread, first);
+                }
+                for (uint64_t k = first; k < buffer->num_events; k++) {
+                        fprintf(out, ",\n");
+                        write_event(out, buffer->events + k % TRACE_BUFFER_EVENTS, buffer->thread);
+                }
+        }
+        fprintf(out, "\n]}\n");
+}
@@ -0,0 +1,114 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file trace.h
+   @brief A timeline of the visit of the decision tree, in the trace-event
+   format of Chrome and Perfetto.
+
+   Each thread records its events in its own ring buffer of \c
+   TRACE_BUFFER_EVENTS events, without locks: when the buffer is full, the
+   oldest events are overwritten. The buffers are written by \c trace_write,
+   when no thread is recording.
+
+   The size of the trace is bounded by sampling the calls of \c next_node:
+   only the calls at a level not larger than \c max_depth (if not 0), and
+   only one call out of \c every, are recorded, together with the
+   realization, the backtrack and the completion of a component that happen
+   in those calls.
+*/
+#ifndef CPPP_TRACE_H
+#define CPPP_TRACE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define TRACE_BUFFER_EVENTS     (1 << 18)
+
+#define TRACE_SEARCH            0
+#define TRACE_NEXT_NODE         1
+#define TRACE_REALIZE           2
+#define TRACE_BACKTRACK         3
+#define TRACE_COMPONENT         4
+
+/**
+   \struct trace_event_s
+   \brief an event of the trace. The events that are not spans have a
+   negative \c duration. The meaning of \c args depends on \c kind:
+
+   \c TRACE_SEARCH: a search, with its outcome and its number of nodes
+
+   \c TRACE_NEXT_NODE: a call of \c next_node at the level \c args[0]
+
+   \c TRACE_REALIZE: the realization of the character \c args[1] at the
+   level \c args[0], which was inactive iff \c args[2] is 1, with outcome
+   \c args[3]
+
+   \c TRACE_BACKTRACK: a backtrack from the level \c args[0] to the level
+   \c args[1] (-1 if the search ends)
+
+   \c TRACE_COMPONENT: the component solved between the levels \c args[1]
+   and \c args[0] has been completed
+*/
+typedef struct trace_event_s {
+        double start;
+        double duration;
+        uint32_t kind;
+        int64_t args[4];
+} trace_event_s;
+
+/**
+   \brief starts tracing all threads, sampling the calls of \c next_node
+   according to \c max_depth and \c every
+*/
+void
+trace_start(uint32_t max_depth, uint32_t every);
+
+/**
+   \brief \c true iff the call number \c step of \c next_node of a search,
+   at the level \c level, must be recorded. It is always \c false if the
+   trace has not been started.
+*/
+bool
+trace_sampled(uint32_t level, uint64_t step);
+
+/**
+   \brief \c true iff the trace has been started
+*/
+bool
+trace_enabled(void);
+
+/**
+   \brief records an event of the calling thread, which started at time
+   \c start (as returned by \c monotonic_seconds) and lasted \c duration
+   seconds, or is not a span if \c duration is negative
+*/
+void
+trace_event(uint32_t kind, double start, double duration, int64_t arg0, int64_t arg1, int64_t arg2, int64_t arg3);
+
+/**
+   \brief writes all the events recorded to \c out, as a JSON object
+   readable by \c chrome://tracing and by Perfetto. Each thread that has
+   recorded an event has its own track.
+*/
+void
+trace_write(FILE *out);
+#endif
@@ -0,0 +1,178 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+#include "perfect_phylogeny.h"
+#include "transposition_table.h"
+
+#define TRANSPOSITION_INITIAL_BUCKETS 1024
+
+#define FINGERPRINT_SPECIES     (1ULL << 62)
+#define FINGERPRINT_CHARACTER   (2ULL << 62)
+#define FINGERPRINT_EDGE        (3ULL << 62)
+
+/**
+   \brief adds the value \c x to the two independent hashes of \c key
+*/
+static inline void
+fingerprint_add(uint64_t key[2], uint64_t x) {
+        uint64_t h = key[0] ^ x;
+        key[0] = ((h << 31) | (h >> 33)) * 0x9e3779b97f4a7c15ULL;
+        h = key[1] + x;
+        key[1] = ((h << 27) | (h >> 37)) * 0xc2b2ae3d27d4eb4fULL + 0x165667b19e3779f9ULL;
+}
+
+static inline uint64_t
+fingerprint_finalize(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+}
+
+/**
+   \brief computes the fingerprint of the state \c stp.
+
+   Species, characters and edges are visited in the order of their indices,
+   so that the same state always has the same fingerprint, regardless of
+   the order in which it has been reached.
+*/
+static void
+fingerprint(const state_s* stp, uint64_t key[2]) {
+        key[0] = 0xcbf29ce484222325ULL;
+        key[1] = 0x84222325cbf29ce4ULL;
+        uint32_t n = stp->num_species_orig;
+        for (uint32_t s = bitmap_next_set(stp->species, n, 0); s < n; s = bitmap_next_set(stp->species, n, s + 1)) {
+                fingerprint_add(key, FINGERPRINT_SPECIES | s);
+                for (uint32_t w = graph_next_neighbor(stp->red_black, s, n); w < stp->red_black->num_vertices;
+                     w = graph_next_neighbor(stp->red_black, s, w + 1))
+                        fingerprint_add(key, FINGERPRINT_EDGE | ((uint64_t) s << 32) | (w - n));
+        }
+        for (uint32_t c = bitmap_next_set(stp->characters, stp->num_characters_orig, 0); c < stp->num_characters_orig;
+             c = bitmap_next_set(stp->characters, stp->num_characters_orig, c + 1))
+                fingerprint_add(key, FINGERPRINT_CHARACTER | ((uint64_t) stp->colors[c] << 32) | c);
+        key[0] = fingerprint_finalize(key[0]);
+        key[1] = fingerprint_finalize(key[1]);
+}
+
+static inline transposition_entry_s*
+bucket(const transposition_table_s* table, const uint64_t key[2]) {
+        return table->entries + (key[0] & (table->num_buckets - 1)) * TRANSPOSITION_BUCKET_SIZE;
+}
+
+/**
+   \brief puts \c entry in its bucket.
+
+   The first entry of the bucket is the entry with the smallest depth, and
+   the other entries are sorted from the most recent. If the bucket is full,
+   its last entry is discarded.
+
+   \return 0 if the key was already in the table, 1 if the entry has been
+   added to the table, and 2 if it has replaced another entry
+*/
+static uint32_t
+put_entry(transposition_table_s* table, transposition_entry_s entry) {
+        transposition_entry_s* b = bucket(table, entry.key);
+        for (uint32_t i = 0; i < TRANSPOSITION_BUCKET_SIZE && b[i].depth > 0; i++)
+                if (b[i].key[0] == entry.key[0] && b[i].key[1] == entry.key[1]) {
+                        if (entry.depth < b[i].depth)
+                                b[i].depth = entry.depth;
+                        return 0;
+                }
+        uint32_t pos = (b[0].depth == 0 || entry.depth <= b[0].depth) ? 0 : 1;
+        uint32_t last = pos;
+        for (; last < TRANSPOSITION_BUCKET_SIZE - 1 && b[last].depth > 0; last++) ;
+        uint32_t outcome = (b[last].depth > 0) ? 2 : 1;
+        memmove(b + pos + 1, b + pos, (last - pos) * sizeof(transposition_entry_s));
+        b[pos] = entry;
+        return outcome;
+}
+
+/**
+   \brief doubles the number of buckets. Since the entries of a bucket are
+   split between two buckets, no entry is discarded.
+*/
+static void
+grow(transposition_table_s* table) {
+        transposition_entry_s* old = table->entries;
+        size_t old_size = table->num_buckets * TRANSPOSITION_BUCKET_SIZE;
+        table->num_buckets *= 2;
+        table->entries = xmalloc_atomic(table->num_buckets * TRANSPOSITION_BUCKET_SIZE * sizeof(transposition_entry_s));
+        for (size_t i = 0; i < old_size; i++)
+                if (old[i].depth > 0)
+                        put_entry(table, old[i]);
+        log_debug("transposition table: grown to %zu buckets", table->num_buckets);
+}
+
+transposition_table_s*
+transposition_table_new(size_t max_bytes) {
+        size_t max_buckets = max_bytes / (TRANSPOSITION_BUCKET_SIZE * sizeof(transposition_entry_s));
+        if (max_buckets == 0)
+                return NULL;
+        transposition_table_s* table = xmalloc(sizeof(transposition_table_s));
+        for (table->max_buckets = 1; 2 * table->max_buckets <= max_buckets; table->max_buckets *= 2) ;
+        table->num_buckets = (table->max_buckets < TRANSPOSITION_INITIAL_BUCKETS) ?
+                table->max_buckets : TRANSPOSITION_INITIAL_BUCKETS;
+        table->entries = xmalloc_atomic(table->num_buckets * TRANSPOSITION_BUCKET_SIZE * sizeof(transposition_entry_s));
+        return table;
+}
+
+bool
+transposition_table_lookup(transposition_table_s* table, const state_s* stp) {
+        uint64_t key[2];
+        fingerprint(stp, key);
+        table->lookups++;
+        transposition_entry_s* b = bucket(table, key);
+        for (uint32_t i = 0; i < TRANSPOSITION_BUCKET_SIZE && b[i].depth > 0; i++)
+                if (b[i].key[0] == key[0] && b[i].key[1] == key[1]) {
+                        table->hits++;
+                        return true;
+                }
+        return false;
+}
+
+void
+transposition_table_store(transposition_table_s* table, const state_s* stp, uint32_t level) {
+        transposition_entry_s entry = { .depth = level + 1 };
+        fingerprint(stp, entry.key);
+        size_t size = table->num_buckets * TRANSPOSITION_BUCKET_SIZE;
+        if (table->num_buckets < table->max_buckets &&
+            (4 * table->num_entries >= 3 * size ||
+             (4 * table->num_entries >= size && bucket(table, entry.key)[TRANSPOSITION_BUCKET_SIZE - 1].depth > 0)))
+                grow(table);
+        uint32_t outcome = put_entry(table, entry);
+        if (outcome == 0)
+                return;
+        table->stored++;
+        if (outcome == 1)
+                table->num_entries++;
+        else
+                table->replaced++;
+}
+
+void
+log_transposition_table(const transposition_table_s* table) {
+        log_info("transposition table: %" PRIu64 " lookups, %" PRIu64 " hits (%.2f%%), %" PRIu64 " states stored, %" PRIu64 " replaced, %zu bytes",
+                 table->lookups, table->hits,
+                 (table->lookups > 0) ? 100.0 * table->hits / table->lookups : 0.0,
+                 table->stored, table->replaced,
+                 table->num_buckets * TRANSPOSITION_BUCKET_SIZE * sizeof(transposition_entry_s));
+}
@@ -0,0 +1,106 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file transposition_table.h
+   @brief A bounded table of the states of the decision tree that have no
+   solution.
+
+   The same state can be reached by realizing the same characters in
+   different orders. Each state is identified by a fingerprint of 128 bits,
+   computed from the current species and characters, the colors of the
+   characters and the edges of the red-black graph. The whole graph is
+   considered, and not only the current component, since the failure of a
+   node can be caused by any of the components.
+
+   The table is a hash table of buckets of \c TRANSPOSITION_BUCKET_SIZE
+   entries. It starts small and it doubles whenever it is 3/4 full, or it
+   is 1/4 full and a bucket overflows, until its size reaches \c
+   max_bytes. Afterwards an entry is replaced when its bucket is full: the
+   first entry of each bucket is the state closest to the root, since its
+   subtree is the largest that can be pruned, while the other entries are
+   replaced by the most recent states.
+*/
+#ifndef CPPP_TRANSPOSITION_TABLE_H
+#define CPPP_TRANSPOSITION_TABLE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TRANSPOSITION_BUCKET_SIZE 2
+
+struct state_s;
+
+/**
+   \struct transposition_entry_s
+   \brief a state without solution. \c depth is the level of the decision
+   tree where the state has been found plus 1, and it is 0 for the empty
+   entries.
+*/
+typedef struct transposition_entry_s {
+        uint64_t key[2];
+        uint32_t depth;
+} transposition_entry_s;
+
+/**
+   \struct transposition_table_s
+   \brief the table and the counters of its usage. \c num_buckets is a
+   power of 2.
+*/
+typedef struct transposition_table_s {
+        transposition_entry_s *entries;
+        size_t num_buckets;
+        size_t max_buckets;
+        uint64_t num_entries;
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t stored;
+        uint64_t replaced;
+} transposition_table_s;
+
+/**
+   \brief allocates a new empty table, whose size is at most \c max_bytes.
+
+   \return \c NULL if \c max_bytes is too small to hold a bucket
+*/
+transposition_table_s*
+transposition_table_new(size_t max_bytes);
+
+/**
+   \brief \c true iff the state \c stp has been stored in the table
+*/
+bool
+transposition_table_lookup(transposition_table_s* table, const struct state_s* stp);
+
+/**
+   \brief stores the state \c stp, found at level \c level of the decision
+   tree, after that all its subtree has been visited without finding a
+   solution
+*/
+void
+transposition_table_store(transposition_table_s* table, const struct state_s* stp, uint32_t level);
+
+/**
+   \brief logs the hit rate and the usage of the table
+*/
+void
+log_transposition_table(const transposition_table_s* table);
+#endif
@@ -0,0 +1,89 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file conflict_graph.c
+   @brief Microbenchmark of \c update_conflict_graph.
+
+   The conflict graph of a random instance is computed with the bit-packed
+   four gametes test and compared with a scalar test on the red-black graph.
+*/
+#include <time.h>
+#include "perfect_phylogeny.h"
+
+static double
+now(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool
+scalar_conflict(const state_s* stp, uint32_t c1, uint32_t c2) {
+        uint32_t n = stp->num_species_orig;
+        if (stp->connected_components[n + c1] != stp->connected_components[n + c2])
+                return false;
+        bool gametes[2][2] = { { false, false }, { false, false } };
+        for (uint32_t s = 0; s < n; s++)
+                if (stp->connected_components[s] == stp->connected_components[n + c1])
+                        gametes[graph_get_edge(stp->red_black, s, n + c1)][graph_get_edge(stp->red_black, s, n + c2)] = true;
+        return gametes[0][0] && gametes[0][1] && gametes[1][0] && gametes[1][1];
+}
+
+static void
+bench(uint32_t n, uint32_t m, double density) {
+        state_s st;
+        init_state(&st, n, m);
+        unsigned int seed = 42;
+        for (uint32_t s = 0; s < n; s++)
+                for (uint32_t c = 0; c < m; c++)
+                        if (rand_r(&seed) < density * RAND_MAX)
+                                graph_add_edge(st.red_black, s, n + c);
+        update_connected_components(&st);
+
+        double start = now();
+        update_conflict_graph(&st);
+        double elapsed = now() - start;
+
+        bool same = true;
+        uint32_t edges = 0;
+        for (uint32_t c1 = 0; c1 < m && same; c1++)
+                for (uint32_t c2 = c1 + 1; c2 < m; c2++) {
+                        bool conflict = graph_get_edge(st.conflict, c1, c2);
+                        edges += conflict;
+                        if (conflict != scalar_conflict(&st, c1, c2)) {
+                                same = false;
+                                break;
+                        }
+                }
+        printf("%5u x %5u density %.3f threads %2d  update_conflict_graph %10.3f ms  edges %9u %s\n",
+               n, m, density, omp_get_max_threads(), elapsed * 1e3, edges, same ? "" : "MISMATCH");
+}
+
+int main(void) {
+        set_graph_representations(GRAPH_BIPARTITE, GRAPH_BITMAP);
+        bench(100, 100, 0.5);
+        bench(100, 100, 0.02);
+        bench(200, 1000, 0.3);
+        bench(200, 6000, 0.3);
+        bench(200, 6000, 0.01);
+        return 0;
+}
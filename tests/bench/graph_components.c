@@ -0,0 +1,89 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file graph_components.c
+   @brief Microbenchmark of \c connected_components and \c graph_reachable.
+
+   The same random red-black graph (species on a side, characters on the
+   other) is stored with each representation. \c GRAPH_DENSE uses the scalar
+   visit over the adjacency lists, while \c GRAPH_BITMAP and \c
+   GRAPH_BIPARTITE use the bit-parallel frontier visit.
+*/
+#include <time.h>
+#include "graph.h"
+
+static double
+now(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static graph_s*
+random_red_black(uint32_t n, uint32_t m, double density, uint32_t representation) {
+        graph_s* gp = (representation == GRAPH_BIPARTITE) ? graph_new_bipartite(n, m) :
+                graph_new_representation(n + m, representation);
+        unsigned int seed = 42;
+        for (uint32_t s = 0; s < n; s++)
+                for (uint32_t c = 0; c < m; c++)
+                        if (rand_r(&seed) < density * RAND_MAX)
+                                graph_add_edge(gp, s, n + c);
+        return gp;
+}
+
+static void
+bench(uint32_t n, uint32_t m, double density) {
+        const char* names[] = { "dense", "bitmap", "bipartite" };
+        uint32_t repetitions = (n + m > 2000) ? 5 : 50;
+        uint32_t reference[n + m];
+        for (uint32_t representation = GRAPH_DENSE; representation <= GRAPH_BIPARTITE; representation++) {
+                graph_s* gp = random_red_black(n, m, density, representation);
+                uint32_t components[n + m];
+                bool reached[n + m];
+
+                double start = now();
+                for (uint32_t r = 0; r < repetitions; r++)
+                        connected_components(gp, components);
+                double cc = (now() - start) / repetitions;
+
+                start = now();
+                for (uint32_t r = 0; r < repetitions; r++)
+                        graph_reachable(gp, 0, reached);
+                double reach = (now() - start) / repetitions;
+
+                if (representation == GRAPH_DENSE)
+                        memcpy(reference, components, (n + m) * sizeof(uint32_t));
+                bool same = (memcmp(reference, components, (n + m) * sizeof(uint32_t)) == 0);
+                printf("%5u x %5u density %.3f %-9s  connected_components %10.3f ms  graph_reachable %10.3f ms %s\n",
+                       n, m, density, names[representation], cc * 1e3, reach * 1e3, same ? "" : "MISMATCH");
+        }
+}
+
+int main(void) {
+        bench(100, 100, 0.5);
+        bench(100, 100, 0.02);
+        bench(1000, 1000, 0.5);
+        bench(1000, 1000, 0.001);
+        bench(200, 6000, 0.3);
+        bench(200, 6000, 0.0005);
+        return 0;
+}
@@ -0,0 +1,141 @@
+/*
+  cppp - Compute a Constrained Perfect Phylogeny, if it exists
+
+  Copyright (C) 2017 Gianluca Della Vedova
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software Foundation,
+  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+*/
+
+/**
+   @file strategies.c
+   @brief Benchmark of the strategies that order the characters of each node
+   of the decision tree.
+
+   All instances of each file given on the command line are solved with
+   each strategy, and the number of nodes of the decision tree visited and
+   the time are reported. By default, the files are the regression inputs
+   of \c tests/regression/input that are solved directly by \c cppp, that
+   is those with an expected output and without a script. The transposition
+   table has the same default size as in \c cppp.
+*/
+#include "decision_tree.h"
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#define DEFAULT_INPUT_DIR "tests/regression/input"
+#define DEFAULT_OK_DIR "tests/regression/ok"
+#define DEFAULT_SCRIPTS_DIR "tests/regression/scripts"
+
+static double
+now(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+   \brief solves \c instance with \c strategy, adding the nodes of the
+   decision tree to \c *nodes
+
+   \return \c true iff the instance has a solution
+*/
+static bool
+solve(const state_s* instance, strategy_fn strategy, uint64_t* nodes) {
+        uint32_t maxdepth = instance->num_species_orig + 2 * instance->num_characters_orig + 1;
+        state_s* states = xmalloc((maxdepth + 1) * sizeof(state_s));
+        for (uint32_t level = 0; level <= maxdepth; level++)
+                init_state(states + level, instance->num_species_orig, instance->num_characters_orig);
+        copy_state(states + 0, instance);
+        search_stats_s stats;
+        uint32_t result = exhaustive_search(states, strategy, maxdepth, &stats);
+        *nodes += stats.nodes;
+        return result == SEARCH_FOUND;
+}
+
+/**
+   \brief \c true iff \c name is a regression input with an expected output
+   and without a script, so that it contains only valid instances
+*/
+static bool
+plain_regression_input(const char* name) {
+        char ok[sizeof(DEFAULT_OK_DIR) + strlen(name) + 1];
+        char script[sizeof(DEFAULT_SCRIPTS_DIR) + strlen(name) + 4];
+        sprintf(ok, "%s/%s", DEFAULT_OK_DIR, name);
+        sprintf(script, "%s/%s.sh", DEFAULT_SCRIPTS_DIR, name);
+        return access(ok, R_OK) == 0 && access(script, F_OK) != 0;
+}
+
+static void
+bench(char* filename, uint64_t* total_nodes, double* total_time) {
+        instances_schema_s props = {
+                .reader = NULL,
+                .filename = filename
+        };
+        uint32_t k = 0;
+        state_s* instances = xmalloc(sizeof(state_s));
+        for (state_s temp; read_instance_from_filename(&props, &temp); k++) {
+                instances = xrealloc(instances, (k + 1) * sizeof(state_s));
+                instances[k] = temp;
+        }
+        char* name = strrchr(filename, '/');
+        printf("%-40s", (name != NULL) ? name + 1 : filename);
+        for (uint32_t id = 0; id < NUM_STRATEGIES; id++) {
+                uint64_t nodes = 0;
+                uint32_t found = 0;
+                double start = now();
+                for (uint32_t i = 0; i < k; i++)
+                        found += solve(instances + i, get_strategy(id), &nodes);
+                double elapsed = now() - start;
+                printf(" %10" PRIu64 " %8.3fs %3u", nodes, elapsed, found);
+                total_nodes[id] += nodes;
+                total_time[id] += elapsed;
+        }
+        printf("\n");
+}
+
+int main(int argc, char **argv) {
+        GC_INIT();
+        set_transposition_table_size(64 << 20);
+        uint64_t total_nodes[NUM_STRATEGIES] = { 0 };
+        double total_time[NUM_STRATEGIES] = { 0 };
+
+        printf("%-40s", "instance (nodes, time, solved)");
+        for (uint32_t id = 0; id < NUM_STRATEGIES; id++)
+                printf(" %-24s", strategy_name(id));
+        printf("\n");
+        if (argc > 1) {
+                for (int i = 1; i < argc; i++)
+                        bench(argv[i], total_nodes, total_time);
+        } else {
+                struct dirent** entries;
+                int num_entries = scandir(DEFAULT_INPUT_DIR, &entries, NULL, alphasort);
+                if (num_entries < 0)
+                        error(6, 0, "Could not read %s\n", DEFAULT_INPUT_DIR);
+                for (int i = 0; i < num_entries; i++) {
+                        if (entries[i]->d_name[0] == '.' || !plain_regression_input(entries[i]->d_name))
+                                continue;
+                        char filename[sizeof(DEFAULT_INPUT_DIR) + strlen(entries[i]->d_name) + 1];
+                        sprintf(filename, "%s/%s", DEFAULT_INPUT_DIR, entries[i]->d_name);
+                        bench(filename, total_nodes, total_time);
+                }
+        }
+        printf("%-40s", "total");
+        for (uint32_t id = 0; id < NUM_STRATEGIES; id++)
+                printf(" %10" PRIu64 " %8.3fs    ", total_nodes[id], total_time[id]);
+        printf("\n");
+        return 0;
+}
@@ -10,7 +10,14 @@ do
     test -f "$o" || echo "Could not find $o"
     test -f "${regdir}/input/${f}" || echo "Could not find ${regdir}/input/${f}"
     echo "Solving ${regdir}/input/${f}"
-    bin/cppp -o "$o" "${regdir}/input/${f}"
+    # A test can have a script, which receives the input file and writes
+    # on the standard output what is compared with the expected output
+    if test -f "${regdir}/scripts/${f}.sh"
+    then
+        bash "${regdir}/scripts/${f}.sh" "${regdir}/input/${f}" > "$o"
+    else
+        bin/cppp -o "$o" "${regdir}/input/${f}"
+    fi
     diff -uNaw --strip-trailing-cr --ignore-all-space "${o}" "$t" >  "${regdir}/diffs/${f}"
 
     # Remove empty diffs
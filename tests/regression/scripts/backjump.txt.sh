@@ -0,0 +1,16 @@
+# Each instance needs a backjump. The levels skipped by a backjump are
+# stored in the transposition table, so the results must be the same
+# without the table, and the parallel search, which never backjumps, must
+# find a solution for the same instances
+status() {
+        sed 's/^[(:].*/found/' "$1"
+}
+t=$(mktemp -d)
+bin/cppp --stats "$t/stats.json" -o "$t/table" "$1"
+cat "$t/table"
+echo "instances with a backjump: $(grep -c '"backjumps": [1-9]' "$t/stats.json")"
+bin/cppp --table-size 0 -o "$t/no-table" "$1"
+cmp -s "$t/table" "$t/no-table" && echo "--table-size 0: same results"
+bin/cppp -t 2 -o "$t/threads" "$1"
+cmp -s <(status "$t/table") <(status "$t/threads") && echo "-t 2: same status"
+rm -rf "$t"
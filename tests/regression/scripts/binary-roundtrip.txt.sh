@@ -0,0 +1,13 @@
+# Converts the input into the binary format and back into text: the text
+# must have the same matrices as the input, and the binary file must have
+# the same solutions as the input
+t=$(mktemp -d)
+bin/cppp --convert binary -o "$t/input.bin" "$1"
+head -c 7 "$t/input.bin"; echo
+bin/cppp --convert text -o "$t/input.txt" "$t/input.bin"
+diff -wB "$1" "$t/input.txt" > /dev/null && echo "text to binary to text: same matrices"
+bin/cppp -o "$t/text.out" "$1"
+bin/cppp -o "$t/binary.out" "$t/input.bin"
+cmp -s "$t/text.out" "$t/binary.out" && echo "text and binary: same solutions"
+cat "$t/binary.out"
+rm -rf "$t"
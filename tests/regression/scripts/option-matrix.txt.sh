@@ -0,0 +1,19 @@
+# Each line of the input is a pattern of the regression inputs to solve
+# with each option. With -t 4 the results must have the same status (found,
+# not found) as the default sequential search. With --undo the search visits
+# the same nodes, so the results must be the same trees: a change undone
+# wrongly gives a different status or a different tree
+status() {
+        sed 's/^[(:].*/found/' "$1"
+}
+t=$(mktemp -d)
+for f in $(sed 's|^|tests/regression/input/|' "$1"); do
+        bin/cppp -o "$t/default" "$f"
+        bin/cppp -t 4 -o "$t/threads" "$f"
+        cmp -s <(status "$t/default") <(status "$t/threads") || echo "-t 4: different status on $(basename "$f")"
+        bin/cppp --undo -o "$t/undo" "$f"
+        cmp -s "$t/default" "$t/undo" || echo "--undo: different result on $(basename "$f")"
+done
+echo "-t 4: done"
+echo "--undo: done"
+rm -rf "$t"
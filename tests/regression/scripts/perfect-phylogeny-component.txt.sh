@@ -0,0 +1,9 @@
+# The first component has a perfect phylogeny and the second one has a
+# conflict: the search must solve the first component with the perfect
+# phylogeny of its root
+t=$(mktemp -d)
+bin/cppp --stats "$t/stats.json" -o "$t/output.txt" "$1"
+cat "$t/output.txt"
+grep -q '"perfect_phylogeny_nodes": [1-9]' "$t/stats.json" && echo "perfect_phylogeny_nodes > 0"
+grep -o '"perfect_phylogeny": [a-z]*' "$t/stats.json"
+rm -rf "$t"
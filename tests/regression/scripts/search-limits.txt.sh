@@ -0,0 +1,7 @@
+# An instance whose budget is exhausted is reported as Unknown: only the
+# first word of each result is checked, since the number of nodes and the
+# time can change
+echo "node limit"
+bin/cppp --node-limit 2 -o /dev/stdout "$1" | cut -d' ' -f1
+echo "backtrack limit"
+bin/cppp --backtrack-limit 1 -o /dev/stdout "$1" | cut -d' ' -f1 | sed 's/^(.*/tree/'
@@ -0,0 +1,4 @@
+# A header without species must be rejected, instead of reading the same
+# token forever
+bin/cppp -o /dev/null "$1" 2>&1
+echo "exit status $?"